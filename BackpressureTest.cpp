@@ -0,0 +1,176 @@
+// Checks that queueCapacity bounds every queue a submit can land in, including a
+// worker's own deque and the deadline queue, under each RejectionPolicy, and how
+// trySubmit and a blocking submit behave at the bound.
+// Build: g++ -std=c++17 -O2 -pthread BackpressureTest.cpp -o BackpressureTest
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+ThreadPoolOptions boundedOptions(RejectionPolicy policy, size_t capacity = 4) {
+    ThreadPoolOptions options;
+    options.numThreads = 1;
+    options.queueCapacity = capacity;
+    options.rejectionPolicy = policy;
+    return options;
+}
+
+ThreadPoolOptions boundedDeadlineOptions(RejectionPolicy policy, size_t capacity = 4) {
+    ThreadPoolOptions options = boundedOptions(policy, capacity);
+    options.schedulingPolicy = SchedulingPolicy::EarliestDeadlineFirst;
+    return options;
+}
+
+constexpr int Fanout = 100000;
+
+int main() {
+    runCase("a task flooding its own deque gets QueueFull under Throw", [] {
+        ThreadPool pool(boundedOptions(RejectionPolicy::Throw));
+        std::future<int> posted = pool.submit([&pool] {
+            int count = 0;
+            try {
+                for (; count < Fanout; ++count) pool.post([] {});
+            } catch (const QueueFull&) {
+            }
+            return count;
+        });
+        int count = posted.get();
+        pool.shutdown();
+        return count == 4 && pool.rejectedTaskCount() == 1;
+    });
+    std::pair<RejectionPolicy, const char*> inlinePolicies[] = {
+        {RejectionPolicy::CallerRuns, "CallerRuns"}, {RejectionPolicy::Block, "Block"}, {RejectionPolicy::DiscardOldest, "DiscardOldest"}};
+    for (auto [policy, name] : inlinePolicies) {
+        runCase(std::string("a task flooding its own deque runs the overflow itself under ") + name, [policy = policy] {
+            ThreadPool pool(boundedOptions(policy));
+            std::atomic<int> ran{0};
+            std::future<size_t> deepest = pool.submit([&pool, &ran] {
+                size_t depth = 0;
+                for (int i = 0; i < Fanout; ++i) {
+                    pool.post([&ran] { ++ran; });
+                    depth = std::max(depth, pool.localQueueDepth());
+                }
+                return depth;
+            });
+            size_t depth = deepest.get();
+            bool finished = eventually([&] { return ran == Fanout; });
+            pool.shutdown();
+            return finished && depth <= 4 && pool.rejectedTaskCount() == Fanout - 4;
+        });
+    }
+    runCase("postBulk from a task respects the bound", [] {
+        ThreadPool pool(boundedOptions(RejectionPolicy::Throw));
+        std::future<bool> thrown = pool.submit([&pool] {
+            std::vector<std::function<void()>> batch(10, [] {});
+            try {
+                pool.postBulk(batch.begin(), batch.end());
+            } catch (const QueueFull&) {
+                return pool.localQueueDepth() == 4;
+            }
+            return false;
+        });
+        bool ok = thrown.get();
+        pool.shutdown();
+        return ok;
+    });
+    runCase("tryPost from a task fails on a full deque", [] {
+        ThreadPool pool(boundedOptions(RejectionPolicy::Throw));
+        std::future<int> accepted = pool.submit([&pool] {
+            int count = 0;
+            while (count < Fanout && pool.tryPost([] {})) ++count;
+            return count;
+        });
+        int count = accepted.get();
+        pool.shutdown();
+        return count == 4;
+    });
+    runCase("the deadline queue throws QueueFull when full", [] {
+        ThreadPool pool(boundedDeadlineOptions(RejectionPolicy::Throw));
+        BusyWorker busy(pool);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        for (int i = 0; i < 4; ++i) pool.submitWithDeadline(deadline, [] {});
+        bool thrown = false;
+        try {
+            pool.submitWithDeadline(deadline, [] {});
+        } catch (const QueueFull&) {
+            thrown = true;
+        }
+        busy.release();
+        pool.shutdown();
+        return thrown && pool.deadlineQueueDepth() == 0;
+    });
+    runCase("a blocked deadline submit goes through once a worker pops one", [] {
+        ThreadPool pool(boundedDeadlineOptions(RejectionPolicy::Block, 2));
+        BusyWorker busy(pool);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        for (int i = 0; i < 2; ++i) pool.submitWithDeadline(deadline, [] {});
+        std::atomic<bool> queued{false};
+        std::thread blocked([&] {
+            pool.submitWithDeadline(deadline, [] {}).get();
+            queued = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        bool waited = !queued && pool.deadlineQueueDepth() == 2;
+        busy.release();
+        blocked.join();
+        pool.shutdown();
+        return waited && queued;
+    });
+
+    runCase("trySubmit from outside fails on a full queue, then succeeds", [] {
+        ThreadPool pool(boundedOptions(RejectionPolicy::Block));
+        BusyWorker busy(pool);
+        for (int i = 0; i < 4; ++i) pool.post([] {});
+        bool refused = !pool.trySubmit([](int v) { return v; }, 1) && !pool.tryPost([] {});
+        busy.release();
+        bool drained = eventually([&] { return pool.queueDepth(TaskPriority::Normal) == 0; });
+        std::optional<std::future<int>> accepted = pool.trySubmit([](int v) { return v; }, 2);
+        bool ran = accepted && accepted->get() == 2;
+        pool.shutdown();
+        return refused && drained && ran && pool.rejectedTaskCount() == 0;
+    });
+    runCase("a Block submit gives up with QueueFull after submitTimeout", [] {
+        ThreadPoolOptions options = boundedOptions(RejectionPolicy::Block, 2);
+        options.submitTimeout = std::chrono::milliseconds(50);
+        ThreadPool pool(options);
+        BusyWorker busy(pool);
+        for (int i = 0; i < 2; ++i) pool.post([] {});
+        auto before = std::chrono::steady_clock::now();
+        bool thrown = false;
+        try {
+            pool.post([] {});
+        } catch (const QueueFull&) {
+            thrown = true;
+        }
+        auto waited = std::chrono::steady_clock::now() - before;
+        busy.release();
+        pool.shutdown();
+        return thrown && waited >= std::chrono::milliseconds(50) && pool.rejectedTaskCount() == 1;
+    });
+    runCase("a Block submit goes through once a worker makes room", [] {
+        ThreadPool pool(boundedOptions(RejectionPolicy::Block, 2));
+        BusyWorker busy(pool);
+        for (int i = 0; i < 2; ++i) pool.post([] {});
+        std::atomic<bool> queued{false};
+        std::thread blocked([&] {
+            pool.post([] {});
+            queued = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        bool waited = !queued;
+        busy.release();
+        blocked.join();
+        pool.shutdown();
+        return waited && queued && pool.rejectedTaskCount() == 0;
+    });
+
+    return finish();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+// thrown from the future of a task whose token was cancelled before it ran, and
+// by CancellationToken::throwIfCancelled()
+class TaskCancelled : public std::runtime_error {
+public:
+    TaskCancelled() : std::runtime_error("ThreadPool task cancelled") {}
+};
+
+// Read side of a cancellation flag. Copies are cheap and share the flag; a
+// default-constructed token can never be cancelled.
+class CancellationToken {
+private:
+    std::shared_ptr<const std::atomic<bool>> flag;
+public:
+    CancellationToken() = default;
+    explicit CancellationToken(std::shared_ptr<const std::atomic<bool>> flag) : flag(std::move(flag)) {}
+
+    bool canBeCancelled() const { return flag != nullptr; }
+    bool isCancelled() const { return flag && flag->load(std::memory_order_relaxed); }
+    // for long-running tasks: bail out at a convenient point once cancelled
+    void throwIfCancelled() const
+    {
+        if(isCancelled()) throw TaskCancelled();
+    }
+};
+
+// Owner side: cancel() flags every token handed out by token(). Cancelling is
+// cooperative and one-way; queued tasks holding the token are skipped when
+// dequeued and running ones notice when they next check it.
+class CancellationSource {
+private:
+    std::shared_ptr<std::atomic<bool>> flag = std::make_shared<std::atomic<bool>>(false);
+public:
+    CancellationToken token() const { return CancellationToken(flag); }
+    void cancel() { flag->store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return flag->load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,151 @@
+#pragma once
+// C++20 coroutine support on top of ThreadPool; needs -std=c++20 (or later).
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <utility>
+#include "ThreadPool.h"
+
+template<typename T>
+class CoTask;
+
+template<typename T>
+class CoTaskPromiseBase {
+public:
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    // when the task finishes, whoever co_awaited it resumes right here on the same thread
+    // (symmetric transfer), so a chain of awaits never blocks a worker or re-enters the queue
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<typename T>
+class CoTaskPromise : public CoTaskPromiseBase<T> {
+public:
+    std::optional<T> value;
+
+    CoTask<T> get_return_object();
+    template<typename U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+    T result()
+    {
+        if(this->exception) std::rethrow_exception(this->exception);
+        return std::move(*value);
+    }
+};
+
+template<>
+class CoTaskPromise<void> : public CoTaskPromiseBase<void> {
+public:
+    CoTask<void> get_return_object();
+    void return_void() {}
+    void result()
+    {
+        if(exception) std::rethrow_exception(exception);
+    }
+};
+
+// Lazily started coroutine producing a T. It starts running when co_awaited and
+// resumes its awaiter when it completes, so dependent steps chain without any
+// thread sitting in future::get(). Use spawn() to start one from plain code.
+template<typename T = void>
+class CoTask {
+public:
+    using promise_type = CoTaskPromise<T>;
+private:
+    std::coroutine_handle<promise_type> handle;
+public:
+    explicit CoTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    CoTask(CoTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    CoTask& operator=(CoTask&& other) noexcept
+    {
+        if(this != &other) {
+            if(handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+    ~CoTask()
+    {
+        if(handle) handle.destroy();
+    }
+
+    struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+        bool await_ready() const noexcept { return !handle || handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return handle.promise().result(); }
+    };
+    Awaiter operator co_await() const noexcept { return Awaiter{handle}; }
+};
+
+template<typename T>
+CoTask<T> CoTaskPromise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<CoTaskPromise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> CoTaskPromise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<CoTaskPromise<void>>::from_promise(*this));
+}
+
+// Eagerly started coroutine that owns itself and frees its frame when done; only
+// used to drive a CoTask from non-coroutine code.
+class DetachedCoroutine {
+public:
+    struct promise_type {
+        DetachedCoroutine get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+template<typename T>
+DetachedCoroutine runOnPool(ThreadPool& pool, CoTask<T> task, std::promise<T> result)
+{
+    try {
+        co_await pool.schedule();
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            result.set_value();
+        } else {
+            result.set_value(co_await std::move(task));
+        }
+    } catch(...) {
+        result.set_exception(std::current_exception());
+    }
+}
+
+// starts the coroutine on one of the pool's workers; the returned future is
+// for the outermost caller only, awaits inside the coroutine never block
+template<typename T>
+std::future<T> spawn(ThreadPool& pool, CoTask<T> task)
+{
+    std::promise<T> result;
+    std::future<T> future = result.get_future();
+    runOnPool(pool, std::move(task), std::move(result));
+    return future;
+}
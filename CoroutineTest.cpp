@@ -0,0 +1,69 @@
+// Checks coroutine sleeps on the pool's timer wheel, including a sleep that
+// shutdown() cuts short. Needs C++20.
+// Build: g++ -std=c++20 -O2 -pthread CoroutineTest.cpp -o CoroutineTest
+#include "CoTask.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <future>
+
+// counts live instances, to tell whether a coroutine frame was freed
+struct FrameMarker {
+    static inline std::atomic<int> live{0};
+    FrameMarker() { ++live; }
+    ~FrameMarker() { --live; }
+};
+
+int main() {
+    runCase("sleepFor resumes on a worker", [] {
+        ThreadPool pool(2);
+        auto work = [&pool]() -> CoTask<bool> {
+            auto before = std::chrono::steady_clock::now();
+            co_await pool.sleepFor(std::chrono::milliseconds(20));
+            co_return pool.isWorkerThread() && std::chrono::steady_clock::now() - before >= std::chrono::milliseconds(20);
+        };
+        bool ok = spawn(pool, work()).get();
+        pool.shutdown();
+        return ok;
+    });
+    runCase("shutdown cancels a pending sleep and frees the frame", [] {
+        ThreadPool pool(1);
+        std::atomic<bool> asleep{false};
+        auto work = [&pool, &asleep]() -> CoTask<int> {
+            FrameMarker marker;
+            asleep = true;
+            co_await pool.sleepFor(std::chrono::hours(1));
+            co_return 1;
+        };
+        std::future<int> result = spawn(pool, work());
+        while (!asleep) std::this_thread::yield();
+        pool.shutdown();
+        bool cancelled = false;
+        try {
+            result.get();
+        } catch (const TaskCancelled&) {
+            cancelled = true;
+        }
+        return cancelled && FrameMarker::live == 0;
+    });
+    runCase("a coroutine can handle a cancelled sleep", [] {
+        ThreadPool pool(1);
+        std::atomic<bool> asleep{false};
+        auto work = [&pool, &asleep]() -> CoTask<int> {
+            asleep = true;
+            try {
+                co_await pool.sleepFor(std::chrono::hours(1));
+            } catch (const TaskCancelled&) {
+                co_return 2;
+            }
+            co_return 1;
+        };
+        std::future<int> result = spawn(pool, work());
+        while (!asleep) std::this_thread::yield();
+        pool.shutdown();
+        return result.get() == 2;
+    });
+
+    return finish();
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// one logical CPU; ids that sysfs does not provide are -1
+struct CpuInfo {
+    int id = 0;       // logical CPU number, as used by sched_setaffinity
+    int core = -1;    // physical core, unique across packages; SMT siblings share it
+    int package = -1; // socket
+    int node = -1;    // NUMA node
+    int l3 = -1;      // lowest CPU id sharing this CPU's last-level cache
+};
+
+// Machine layout read from /sys/devices/system/cpu (Linux). Elsewhere, or when
+// sysfs is unavailable, it describes hardware_concurrency() CPUs on one node.
+class CpuTopology {
+private:
+    std::vector<CpuInfo> cpus;
+    std::vector<std::vector<int>> nodes; // CPU ids per NUMA node, indexed by node number
+
+    static bool readFile(const std::string& path, std::string& out)
+    {
+        std::ifstream in(path);
+        if(!in) return false;
+        std::getline(in, out);
+        return true;
+    }
+    static int readInt(const std::string& path)
+    {
+        std::string text;
+        if(!readFile(path, text)) return -1;
+        try {
+            return std::stoi(text);
+        } catch(...) {
+            return -1;
+        }
+    }
+    void detect()
+    {
+        namespace fs = std::filesystem;
+        const std::string root = "/sys/devices/system/cpu/";
+        std::string online;
+        if(!readFile(root + "online", online)) return;
+        for(int id : parseCpuList(online)) {
+            const std::string dir = root + "cpu" + std::to_string(id) + "/";
+            CpuInfo cpu;
+            cpu.id = id;
+            cpu.package = readInt(dir + "topology/physical_package_id");
+            int coreId = readInt(dir + "topology/core_id");
+            // core_id repeats across packages; the first thread sibling names the core uniquely
+            std::string siblings;
+            if(readFile(dir + "topology/thread_siblings_list", siblings) && !parseCpuList(siblings).empty()) {
+                cpu.core = parseCpuList(siblings).front();
+            } else {
+                cpu.core = coreId;
+            }
+            for(int index = 0; ; ++index) {
+                const std::string cache = dir + "cache/index" + std::to_string(index) + "/";
+                int level = readInt(cache + "level");
+                if(level < 0) break;
+                std::string shared;
+                if(level >= 3 && readFile(cache + "shared_cpu_list", shared) && !parseCpuList(shared).empty()) {
+                    cpu.l3 = parseCpuList(shared).front();
+                }
+            }
+            std::error_code ec;
+            for(const auto& entry : fs::directory_iterator(dir, ec)) {
+                const std::string name = entry.path().filename().string();
+                if(name.size() > 4 && name.compare(0, 4, "node") == 0) {
+                    try {
+                        cpu.node = std::stoi(name.substr(4));
+                    } catch(...) {
+                    }
+                }
+            }
+            cpus.push_back(cpu);
+        }
+    }
+public:
+    CpuTopology()
+    {
+#if defined(__linux__)
+        detect();
+#endif
+        if(cpus.empty()) {
+            unsigned count = std::max(1u, std::thread::hardware_concurrency());
+            for(unsigned i = 0; i < count; ++i) {
+                CpuInfo cpu;
+                cpu.id = static_cast<int>(i);
+                cpus.push_back(cpu);
+            }
+        }
+        for(CpuInfo& cpu : cpus) {
+            if(cpu.node < 0) cpu.node = 0;
+            if(cpu.core < 0) cpu.core = cpu.id;
+            if(cpu.package < 0) cpu.package = cpu.node;
+            if(static_cast<size_t>(cpu.node) >= nodes.size()) nodes.resize(cpu.node + 1);
+            nodes[cpu.node].push_back(cpu.id);
+        }
+    }
+
+    // parses a sysfs CPU list such as "0-3,8,10-11"
+    static std::vector<int> parseCpuList(const std::string& text)
+    {
+        std::vector<int> ids;
+        std::stringstream in(text);
+        std::string part;
+        while(std::getline(in, part, ',')) {
+            try {
+                size_t dash = part.find('-');
+                int first = std::stoi(part.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(part.substr(dash + 1));
+                for(int id = first; id <= last; ++id) ids.push_back(id);
+            } catch(...) {
+                // empty or malformed piece
+            }
+        }
+        return ids;
+    }
+
+    const std::vector<CpuInfo>& allCpus() const { return cpus; }
+    // number of NUMA nodes, node numbers run from 0; a node may have no CPUs
+    size_t nodeCount() const { return nodes.size(); }
+    const std::vector<int>& cpusOfNode(size_t node) const { return nodes.at(node); }
+    // info for a logical CPU id, nullptr if it is not online
+    const CpuInfo* cpu(int id) const
+    {
+        for(const CpuInfo& info : cpus) {
+            if(info.id == id) return &info;
+        }
+        return nullptr;
+    }
+    // one single-CPU affinity set per CPU of the node (all CPUs for node < 0), ordered
+    // so consecutive workers land on different physical cores before SMT siblings
+    // are doubled up
+    std::vector<std::vector<int>> perCpuAffinity(int node = -1) const
+    {
+        std::vector<CpuInfo> chosen;
+        for(const CpuInfo& info : cpus) {
+            if(node < 0 || info.node == node) chosen.push_back(info);
+        }
+        // rank of each CPU among its core's siblings: all first threads, then all second ...
+        std::vector<std::pair<int, CpuInfo>> ranked;
+        for(const CpuInfo& info : chosen) {
+            int rank = 0;
+            for(const CpuInfo& other : chosen) {
+                if(other.core == info.core && other.id < info.id) ++rank;
+            }
+            ranked.emplace_back(rank, info);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        std::vector<std::vector<int>> sets;
+        for(const auto& entry : ranked) sets.push_back({entry.second.id});
+        return sets;
+    }
+};
+
+// restricts the calling thread to the given CPUs; false if that is not supported
+// or the kernel refused (e.g. a CPU outside the process's cpuset)
+inline bool pinCurrentThread(const std::vector<int>& cpus)
+{
+#if defined(__linux__)
+    if(cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int id : cpus) {
+        if(id >= 0 && id < CPU_SETSIZE) CPU_SET(id, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
@@ -0,0 +1,144 @@
+// Checks that the pool's helpers finish under RejectionPolicy::DiscardOldest: one
+// worker held busy, a two-slot queue, and plain posts flooding it so every queued
+// task that can be discarded is.
+// Build: g++ -std=c++20 -O2 -pthread DiscardOldestTest.cpp -o DiscardOldestTest
+// (C++17 works too, without the coroutine case)
+#include "Parallel.h"
+#include "PoolFuture.h"
+#include "Strand.h"
+#include "TaskGraph.h"
+#include "TaskGroup.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#if defined(__cpp_impl_coroutine)
+#include "CoTask.h"
+#endif
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+ThreadPoolOptions discardingOptions() {
+    ThreadPoolOptions options;
+    options.numThreads = 1;
+    options.queueCapacity = 2;
+    options.rejectionPolicy = RejectionPolicy::DiscardOldest;
+    return options;
+}
+
+void flood(ThreadPool& pool, int count = 8) {
+    for (int i = 0; i < count; ++i) pool.post([] {});
+}
+
+int main() {
+    runCase("TaskGroup children", [] {
+        ThreadPool pool(discardingOptions());
+        BusyWorker busy(pool);
+        std::atomic<int> ran{0};
+        TaskGroup group(pool);
+        for (int i = 0; i < 4; ++i) group.run([&ran] { ++ran; });
+        flood(pool);
+        busy.release();
+        group.wait();
+        pool.shutdown();
+        return ran == 4;
+    });
+    runCase("parallelFor halves", [] {
+        ThreadPool pool(discardingOptions());
+        std::atomic<bool> done{false};
+        std::thread flooder([&] {
+            while (!done) flood(pool, 1);
+        });
+        std::atomic<long> sum{0};
+        parallelFor(pool, 0, 100000, [&sum](int i) { sum += i; }, 64);
+        done = true;
+        flooder.join();
+        pool.shutdown();
+        return sum == 100000L * 99999 / 2;
+    });
+    runCase("TaskGraph nodes", [] {
+        ThreadPool pool(discardingOptions());
+        BusyWorker busy(pool);
+        std::atomic<int> ran{0};
+        TaskGraph graph;
+        TaskGraph::NodeId root = graph.add([&ran] { ++ran; });
+        for (int i = 0; i < 6; ++i) graph.precede(root, graph.add([&ran] { ++ran; }));
+        std::thread runner([&] { graph.run(pool); });
+        flood(pool);
+        busy.release();
+        runner.join();
+        pool.shutdown();
+        return ran == 7;
+    });
+    runCase("Strand drain", [] {
+        ThreadPool pool(discardingOptions());
+        BusyWorker busy(pool);
+        std::atomic<int> ran{0};
+        Strand strand(pool);
+        strand.post([&ran] { ++ran; });
+        flood(pool);
+        busy.release();
+        strand.wait();
+        bool first = ran == 1;
+        strand.post([&ran] { ++ran; }); // the strand must not be stuck "scheduled"
+        strand.wait();
+        pool.shutdown();
+        return first && ran == 2;
+    });
+    runCase("KeyedExecutor drain", [] {
+        ThreadPool pool(discardingOptions());
+        BusyWorker busy(pool);
+        std::atomic<int> ran{0};
+        KeyedExecutor<int> executor(pool);
+        for (int key = 0; key < 3; ++key) executor.post(key, [&ran] { ++ran; });
+        flood(pool);
+        busy.release();
+        executor.wait();
+        pool.shutdown();
+        return ran == 3 && executor.activeKeyCount() == 0;
+    });
+    runCase("PoolFuture continuation", [] {
+        ThreadPool pool(discardingOptions());
+        BusyWorker busy(pool);
+        PoolFuture<int> next = makeReadyFuture<int>(&pool, 1).then([](const int& v) { return v + 1; });
+        flood(pool);
+        busy.release();
+        int value = next.get();
+        pool.shutdown();
+        return value == 2;
+    });
+    runCase("runAsync dropped reports broken_promise", [] {
+        ThreadPool pool(discardingOptions());
+        BusyWorker busy(pool);
+        PoolFuture<int> dropped = runAsync(pool, [] { return 1; });
+        flood(pool);
+        busy.release();
+        bool broken = false;
+        try {
+            dropped.get();
+        } catch (const std::future_error& e) {
+            broken = e.code() == std::future_errc::broken_promise;
+        }
+        pool.shutdown();
+        return broken;
+    });
+#if defined(__cpp_impl_coroutine)
+    runCase("coroutine resume", [] {
+        ThreadPool pool(discardingOptions());
+        BusyWorker busy(pool);
+        auto work = [&pool]() -> CoTask<int> {
+            co_await pool.schedule();
+            co_await pool.sleepFor(std::chrono::milliseconds(1));
+            co_return 7;
+        };
+        std::future<int> result = spawn(pool, work());
+        flood(pool);
+        busy.release();
+        int value = result.get();
+        pool.shutdown();
+        return value == 7;
+    });
+#endif
+
+    return finish();
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// hint to the CPU that we are in a spin-wait loop
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Condition variable without a predicate mutex. A waiter announces itself with
+// prepareWait(), re-checks its condition, and then either cancelWait()s or
+// wait()s; a notifier changes the condition first and then calls notify().
+// notify() is a single atomic load when nobody is waiting, so producers never
+// pay for a lock or a futex call unless a consumer is actually parked.
+class EventCount {
+private:
+    // high 32 bits: epoch, bumped by every notify; low 32 bits: number of waiters
+    std::atomic<uint64_t> state{0};
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    static constexpr uint64_t WaiterMask = 0xffffffffull;
+    static constexpr uint64_t EpochOne = 1ull << 32;
+public:
+    using Key = uint32_t;
+
+    Key prepareWait() { return static_cast<Key>(state.fetch_add(1) >> 32); }
+    void cancelWait() { state.fetch_sub(1); }
+    // blocks until a notify() issued after the matching prepareWait()
+    void wait(Key key)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return static_cast<Key>(state.load() >> 32) != key; });
+        }
+        state.fetch_sub(1);
+    }
+    // like wait(), but gives up at deadline; false if it timed out without a notify()
+    template<typename Clock, typename Duration>
+    bool waitUntil(Key key, const std::chrono::time_point<Clock, Duration>& deadline)
+    {
+        bool notified;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            notified = cv.wait_until(lock, deadline, [&] { return static_cast<Key>(state.load() >> 32) != key; });
+        }
+        state.fetch_sub(1);
+        return notified;
+    }
+    // wakes up to count waiters
+    void notify(size_t count = 1)
+    {
+        uint64_t s = state.load();
+        size_t waiters = static_cast<size_t>(s & WaiterMask);
+        if(waiters == 0 || count == 0) return;
+        state.fetch_add(EpochOne);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+        }
+        if(count >= waiters) {
+            cv.notify_all();
+        } else {
+            for(size_t i = 0; i < count; ++i) cv.notify_one();
+        }
+    }
+    void notifyAll() { notify(SIZE_MAX); }
+    size_t waiters() const { return static_cast<size_t>(state.load() & WaiterMask); }
+};
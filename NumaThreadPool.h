@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "CpuTopology.h"
+#include "ThreadPool.h"
+
+// One ThreadPool per NUMA node, with every worker pinned to a CPU of its node.
+// Work tagged with a node runs there, next to the memory it touches, and
+// stealing never crosses a socket since each sub-pool only steals internally.
+// Untagged work stays on the submitting worker's node, or is spread round-robin
+// when submitted from outside.
+class NumaThreadPool {
+private:
+    CpuTopology topology;
+    std::vector<std::unique_ptr<ThreadPool>> pools; // indexed by node; null for nodes without CPUs
+    std::vector<size_t> activeNodes;                // nodes that have a pool
+    std::atomic<size_t> nextNode{0};
+
+    ThreadPool& pick()
+    {
+        size_t node = currentNode();
+        if(node < pools.size()) return *pools[node];
+        return *pools[activeNodes[nextNode.fetch_add(1, std::memory_order_relaxed) % activeNodes.size()]];
+    }
+public:
+    // threadsPerNode 0 starts one worker per CPU of each node. options applies to every
+    // sub-pool; its numThreads and workerAffinity are replaced per node.
+    explicit NumaThreadPool(size_t threadsPerNode = 0, ThreadPoolOptions options = ThreadPoolOptions())
+    {
+        pools.resize(topology.nodeCount());
+        for(size_t node = 0; node < topology.nodeCount(); ++node) {
+            if(topology.cpusOfNode(node).empty()) continue;
+            options.numThreads = threadsPerNode > 0 ? threadsPerNode : topology.cpusOfNode(node).size();
+            if(options.maxThreads > 0) options.maxThreads = std::max(options.maxThreads, options.numThreads);
+            options.workerAffinity = topology.perCpuAffinity(static_cast<int>(node));
+            pools[node] = std::make_unique<ThreadPool>(options);
+            activeNodes.push_back(node);
+        }
+    }
+    NumaThreadPool(const NumaThreadPool&) = delete;
+    NumaThreadPool& operator=(const NumaThreadPool&) = delete;
+
+    const CpuTopology& cpuTopology() const { return topology; }
+    // node numbers run from 0 to nodeCount() - 1; nodes without CPUs have no pool
+    size_t nodeCount() const { return pools.size(); }
+    bool hasNode(size_t node) const { return node < pools.size() && pools[node]; }
+    ThreadPool& nodePool(size_t node)
+    {
+        if(!hasNode(node)) throw std::out_of_range("NumaThreadPool has no workers on that node");
+        return *pools[node];
+    }
+    // node of the calling worker, or nodeCount() on any other thread
+    size_t currentNode() const
+    {
+        for(size_t node : activeNodes) {
+            if(pools[node]->isWorkerThread()) return node;
+        }
+        return pools.size();
+    }
+    size_t size() const
+    {
+        size_t total = 0;
+        for(size_t node : activeNodes) total += pools[node]->size();
+        return total;
+    }
+
+    // runs on a worker of the given node
+    template<typename F, typename... Args>
+    auto submitOn(size_t node, F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        return nodePool(node).submit(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+    template<typename F, typename... Args>
+    void postOn(size_t node, F&& f, Args&&... args)
+    {
+        nodePool(node).post(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+    // untagged: the caller's node on a worker, round-robin over nodes elsewhere
+    template<typename F, typename... Args>
+    auto submit(F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        return pick().submit(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+    template<typename F, typename... Args>
+    void post(F&& f, Args&&... args)
+    {
+        pick().post(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+    void shutdown()
+    {
+        for(size_t node : activeNodes) pools[node]->shutdown();
+    }
+};
@@ -0,0 +1,349 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "ThreadPool.h"
+
+// default sequential chunk for a loop of n iterations: small enough to give every
+// thread plenty of pieces to balance with, large enough to hide the split overhead
+inline size_t autoGrainSize(size_t n, size_t numThreads)
+{
+    return std::max<size_t>(1, n / (64 * (numThreads + 1)));
+}
+
+// Shared state of one parallelFor call; Body is called with [begin, end)
+// chunks. It lives on the caller's stack: the caller helps until every
+// iteration is accounted for, and a task touches the state for the last time
+// when it subtracts its iterations from `remaining`.
+template<typename Index, typename Body>
+class ParallelForContext {
+private:
+    ThreadPool& pool;
+    Body& body;
+    const size_t grain;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex errorMtx;
+
+    void spawn(Index begin, Index end)
+    {
+        pool.postUnbounded([this, begin, end] { run(begin, end); });
+    }
+public:
+    ParallelForContext(ThreadPool& pool, Body& body, size_t grain, size_t iterations)
+        : pool(pool), body(body), grain(grain), remaining(iterations) {}
+
+    // Lazy binary splitting: the range is halved only while nobody has spare work
+    // to steal from us (our deque is empty); otherwise we run grain iterations and
+    // look again. Splits track actual demand, so an idle pool fans out in log
+    // steps and a busy one runs the range almost sequentially.
+    void run(Index begin, Index end)
+    {
+        size_t owned = static_cast<size_t>(end - begin);
+        try {
+            while(static_cast<size_t>(end - begin) > grain && !failed.load(std::memory_order_relaxed)) {
+                if(pool.localQueueDepth() == 0) {
+                    Index mid = begin + (end - begin) / 2;
+                    spawn(mid, end);
+                    owned -= static_cast<size_t>(end - mid);
+                    end = mid;
+                    continue;
+                }
+                Index chunkEnd = begin + static_cast<Index>(grain);
+                body(begin, chunkEnd);
+                begin = chunkEnd;
+            }
+            if(!failed.load(std::memory_order_relaxed)) {
+                body(begin, end);
+            }
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(errorMtx);
+            if(!error) error = std::current_exception();
+            failed.store(true, std::memory_order_relaxed);
+        }
+        remaining.fetch_sub(owned, std::memory_order_acq_rel);
+    }
+    bool done() const { return remaining.load(std::memory_order_acquire) == 0; }
+    void rethrowIfFailed()
+    {
+        if(error) std::rethrow_exception(error);
+    }
+};
+
+// Calls body(chunkBegin, chunkEnd) over disjoint chunks covering [begin, end), on
+// the pool's workers and the calling thread. Work is split on demand (see
+// ParallelForContext::run) and chunks are posted as plain tasks, so there is no
+// future or allocation per chunk. grain is the smallest chunk that is never
+// split, 0 picks one from the loop size. The first exception thrown by body stops
+// further chunks and is rethrown here.
+template<typename Index, typename Body>
+void parallelForRange(ThreadPool& pool, Index begin, Index end, Body&& body, size_t grain = 0)
+{
+    static_assert(std::is_integral_v<Index>, "parallelFor needs an integral index");
+    if(end <= begin) return;
+    size_t n = static_cast<size_t>(end - begin);
+    if(grain == 0) grain = autoGrainSize(n, pool.size());
+    ParallelForContext<Index, std::remove_reference_t<Body>> context(pool, body, grain, n);
+    context.run(begin, end);
+    pool.helpUntil([&] { return context.done(); });
+    context.rethrowIfFailed();
+}
+
+// Calls body(i) for every i in [begin, end), see parallelForRange.
+template<typename Index, typename Body>
+void parallelFor(ThreadPool& pool, Index begin, Index end, Body&& body, size_t grain = 0)
+{
+    parallelForRange(pool, begin, end, [&body](Index chunkBegin, Index chunkEnd) {
+        for(Index i = chunkBegin; i < chunkEnd; ++i) body(i);
+    }, grain);
+}
+
+// One accumulator per worker plus one shared by every thread outside the pool,
+// each on its own cache line so workers never write to the same line.
+template<typename T>
+class PerWorkerAccumulators {
+private:
+    struct alignas(64) Slot {
+        T value;
+    };
+    ThreadPool& pool;
+    std::vector<Slot> slots;
+    std::mutex externalMtx; // the last slot may be hit by several non-worker threads
+public:
+    PerWorkerAccumulators(ThreadPool& pool, const T& identity)
+        : pool(pool), slots(pool.maxSize() + 1, Slot{identity}) {}
+
+    // folds a chunk's partial result into the calling thread's accumulator
+    template<typename Combine>
+    void add(T partial, Combine& combine)
+    {
+        size_t index = pool.workerIndex();
+        if(index < pool.maxSize()) {
+            slots[index].value = combine(std::move(slots[index].value), std::move(partial));
+        } else {
+            std::lock_guard<std::mutex> lock(externalMtx);
+            slots.back().value = combine(std::move(slots.back().value), std::move(partial));
+        }
+    }
+    // pairwise tree over the accumulators; each level's pairs are combined in parallel
+    template<typename Combine>
+    T combineAll(Combine& combine)
+    {
+        size_t n = slots.size();
+        for(size_t stride = 1; stride < n; stride *= 2) {
+            size_t pairs = (n - stride + 2 * stride - 1) / (2 * stride);
+            auto level = [&](size_t pair) {
+                size_t left = pair * 2 * stride;
+                slots[left].value = combine(std::move(slots[left].value), std::move(slots[left + stride].value));
+            };
+            if(pairs > 1) {
+                parallelFor(pool, size_t(0), pairs, level, 1);
+            } else {
+                level(0);
+            }
+        }
+        return std::move(slots.front().value);
+    }
+};
+
+// combine(identity, transform(begin)) ... over [begin, end). Each chunk reduces
+// into a local value, folds it into its worker's padded accumulator, and the
+// accumulators are merged in a tree at the end; no future per chunk and no
+// shared hot counter. combine must be associative and commutative, and identity
+// must be its neutral element.
+template<typename Index, typename T, typename Transform, typename Combine>
+T parallelTransformReduce(ThreadPool& pool, Index begin, Index end, T identity,
+    Transform transform, Combine combine, size_t grain = 0)
+{
+    PerWorkerAccumulators<T> accumulators(pool, identity);
+    parallelForRange(pool, begin, end, [&](Index chunkBegin, Index chunkEnd) {
+        T partial = identity;
+        for(Index i = chunkBegin; i < chunkEnd; ++i) {
+            partial = combine(std::move(partial), transform(i));
+        }
+        accumulators.add(std::move(partial), combine);
+    }, grain);
+    return accumulators.combineAll(combine);
+}
+
+// reduces the random-access range [first, last) with combine, see parallelTransformReduce
+template<typename It, typename T, typename Combine>
+T parallelReduce(ThreadPool& pool, It first, It last, T identity, Combine combine, size_t grain = 0)
+{
+    using Diff = typename std::iterator_traits<It>::difference_type;
+    return parallelTransformReduce(pool, Diff(0), Diff(last - first), std::move(identity),
+        [first](Diff i) -> decltype(auto) { return first[i]; }, combine, grain);
+}
+
+// co-rank for merging sorted runs a[0, m) and b[0, l): the number i of elements
+// taken from a among the first k outputs. Ties go to a, as std::merge does.
+template<typename It, typename Compare>
+size_t mergeSplit(It a, size_t m, It b, size_t l, size_t k, Compare& comp)
+{
+    size_t lo = k > l ? k - l : 0;
+    size_t hi = std::min(k, m);
+    // smallest i with b[k - i - 1] < a[i]
+    while(lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        size_t j = k - i;
+        if(j == 0 || comp(b[j - 1], a[i])) {
+            hi = i;
+        } else {
+            lo = i + 1;
+        }
+    }
+    return lo;
+}
+
+// co-rank of output k within its pair of neighbouring `width`-element runs in src
+template<typename It, typename Compare>
+size_t pairSplit(It src, size_t n, size_t width, size_t k, Compare& comp)
+{
+    size_t pairBegin = k / (2 * width) * (2 * width);
+    size_t mid = std::min(pairBegin + width, n);
+    size_t pairEnd = std::min(pairBegin + 2 * width, n);
+    return mergeSplit(src + pairBegin, mid - pairBegin, src + mid, pairEnd - mid, k - pairBegin, comp);
+}
+
+// writes outputs [k0, k1) of one merge round: src holds sorted runs of `width`
+// elements, pairs of neighbouring runs are merged into dst. i0 and i1 are the
+// pairSplit()s of k0 and k1, found before any segment starts moving elements out
+// of src. A segment may span several pairs; the pair boundaries inside it split trivially.
+template<typename SrcIt, typename DstIt, typename Compare>
+void mergeSegment(SrcIt src, DstIt dst, size_t n, size_t width, size_t k0, size_t k1, size_t i0, size_t i1, Compare& comp)
+{
+    while(k0 < k1) {
+        size_t pairBegin = k0 / (2 * width) * (2 * width);
+        size_t mid = std::min(pairBegin + width, n);
+        size_t pairEnd = std::min(pairBegin + 2 * width, n);
+        size_t end = std::min(k1, pairEnd);
+        size_t iEnd = end == pairEnd ? mid - pairBegin : i1;
+        SrcIt a = src + pairBegin;
+        SrcIt b = src + mid;
+        size_t j0 = k0 - pairBegin - i0;
+        size_t j1 = end - pairBegin - iEnd;
+        std::merge(std::make_move_iterator(a + i0), std::make_move_iterator(a + iEnd),
+            std::make_move_iterator(b + j0), std::make_move_iterator(b + j1), dst + k0, comp);
+        k0 = end;
+        i0 = 0;
+    }
+}
+
+// Parallel merge sort (not stable). Blocks are sorted with std::sort in
+// parallel, then merged pairwise in rounds; every round splits its whole output
+// into equal segments by co-rank, so even the last round, a single merge of
+// two halves, keeps every worker busy. Rounds alternate between the input and
+// one buffer of n default-constructed elements, so the only extra pass is a
+// move back after an odd number of rounds.
+template<typename It, typename Compare = std::less<>>
+void parallelSort(ThreadPool& pool, It first, It last, Compare comp = Compare())
+{
+    using T = typename std::iterator_traits<It>::value_type;
+    size_t n = static_cast<size_t>(last - first);
+    size_t threads = pool.size() + 1;
+    if(n < 16384 || threads < 2) {
+        std::sort(first, last, comp);
+        return;
+    }
+    size_t width = std::max<size_t>((n + 4 * threads - 1) / (4 * threads), 2048);
+    size_t blocks = (n + width - 1) / width;
+    parallelFor(pool, size_t(0), blocks, [&](size_t block) {
+        std::sort(first + block * width, first + std::min(n, (block + 1) * width), comp);
+    }, 1);
+    if(blocks == 1) return;
+
+    std::vector<T> buffer(n);
+    size_t segment = std::max<size_t>(n / (8 * threads), 4096);
+    size_t segments = (n + segment - 1) / segment;
+    std::vector<size_t> splits(segments + 1);
+    auto mergeRound = [&](auto src, auto dst) {
+        parallelFor(pool, size_t(0), segments + 1, [&](size_t s) {
+            splits[s] = pairSplit(src, n, width, std::min(n, s * segment), comp);
+        });
+        parallelFor(pool, size_t(0), segments, [&](size_t s) {
+            mergeSegment(src, dst, n, width, s * segment, std::min(n, (s + 1) * segment),
+                splits[s], splits[s + 1], comp);
+        }, 1);
+    };
+    bool inBuffer = false;
+    for(; width < n; width *= 2) {
+        if(inBuffer) {
+            mergeRound(buffer.data(), first);
+        } else {
+            mergeRound(first, buffer.data());
+        }
+        inBuffer = !inBuffer;
+    }
+    if(inBuffer) {
+        parallelForRange(pool, size_t(0), n, [&](size_t begin, size_t end) {
+            std::move(buffer.begin() + begin, buffer.begin() + end, first + begin);
+        });
+    }
+}
+
+// Two-pass parallel scan over blocks: pass one reduces each block, the block
+// totals are scanned sequentially (there are only a few per thread), pass two
+// rescans every block starting from its offset. Writes through d_first, which
+// may equal first.
+template<typename It, typename OutIt, typename T, typename Op, bool Inclusive>
+void parallelScanImpl(ThreadPool& pool, It first, It last, OutIt d_first, std::optional<T> init, Op op)
+{
+    size_t n = static_cast<size_t>(last - first);
+    if(n == 0) return;
+    size_t threads = pool.size() + 1;
+    size_t width = std::max<size_t>((n + 4 * threads - 1) / (4 * threads), 4096);
+    size_t blocks = (n + width - 1) / width;
+
+    std::vector<std::optional<T>> totals(blocks);
+    if(blocks > 1) {
+        parallelFor(pool, size_t(0), blocks - 1, [&](size_t block) {
+            It it = first + block * width;
+            It end = first + std::min(n, (block + 1) * width);
+            T sum = *it;
+            for(++it; it != end; ++it) sum = op(std::move(sum), *it);
+            totals[block] = std::move(sum);
+        }, 1);
+    }
+    // offsets[b] = init op totals[0] op ... op totals[b - 1]
+    std::vector<std::optional<T>> offsets(blocks);
+    offsets[0] = init;
+    for(size_t block = 1; block < blocks; ++block) {
+        offsets[block] = offsets[block - 1] ? op(*offsets[block - 1], *totals[block - 1]) : *totals[block - 1];
+    }
+    parallelFor(pool, size_t(0), blocks, [&](size_t block) {
+        size_t begin = block * width;
+        size_t end = std::min(n, (block + 1) * width);
+        std::optional<T> acc = offsets[block];
+        for(size_t i = begin; i < end; ++i) {
+            T x = first[i];
+            if constexpr (Inclusive) {
+                acc = acc ? op(std::move(*acc), std::move(x)) : std::move(x);
+                d_first[i] = *acc;
+            } else {
+                d_first[i] = *acc;
+                acc = op(std::move(*acc), std::move(x));
+            }
+        }
+    }, 1);
+}
+
+template<typename It, typename OutIt, typename Op = std::plus<>>
+void parallelInclusiveScan(ThreadPool& pool, It first, It last, OutIt d_first, Op op = Op())
+{
+    using T = typename std::iterator_traits<It>::value_type;
+    parallelScanImpl<It, OutIt, T, Op, true>(pool, first, last, d_first, std::nullopt, op);
+}
+
+template<typename It, typename OutIt, typename T, typename Op = std::plus<>>
+void parallelExclusiveScan(ThreadPool& pool, It first, It last, OutIt d_first, T init, Op op = Op())
+{
+    parallelScanImpl<It, OutIt, T, Op, false>(pool, first, last, d_first, std::optional<T>(std::move(init)), op);
+}
@@ -0,0 +1,273 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "ThreadPool.h"
+
+template<typename T>
+class PoolFuture;
+
+// Shared state behind a PoolFuture. Completion callbacks run inline on the
+// completing thread; they are kept tiny and hand real work to the pool.
+template<typename T>
+class PoolFutureState {
+public:
+    using Stored = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+    ThreadPool* const pool; // where continuations run; nullptr runs them inline
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<bool> ready{false};
+    std::optional<Stored> value;
+    std::exception_ptr error;
+    std::vector<Task> callbacks;
+
+    template<typename Fill>
+    void complete(Fill&& fill)
+    {
+        std::vector<Task> pending;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(ready.load(std::memory_order_relaxed)) throw std::logic_error("PoolFuture completed twice");
+            fill();
+            ready.store(true, std::memory_order_release);
+            pending.swap(callbacks);
+        }
+        cv.notify_all();
+        for(Task& callback : pending) callback();
+    }
+public:
+    explicit PoolFutureState(ThreadPool* pool) : pool(pool) {}
+
+    void setValue(Stored v) { complete([&] { value.emplace(std::move(v)); }); }
+    void setException(std::exception_ptr e) { complete([&] { error = std::move(e); }); }
+    bool isReady() const { return ready.load(std::memory_order_acquire); }
+    // runs callback once the state is ready, immediately if it already is
+    void onReady(Task callback)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(!ready.load(std::memory_order_relaxed)) {
+                callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+    void wait()
+    {
+        if(isReady()) return;
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return ready.load(std::memory_order_relaxed); });
+    }
+    // only valid once ready
+    bool failed() const { return error != nullptr; }
+    std::exception_ptr exception() const { return error; }
+    const Stored& result() const
+    {
+        if(error) std::rethrow_exception(error);
+        return *value;
+    }
+};
+
+// runs f(args...) and stores its outcome in state
+template<typename T, typename F, typename... Args>
+void fulfil(PoolFutureState<T>& state, F& f, Args&&... args)
+{
+    try {
+        if constexpr (std::is_void_v<T>) {
+            std::invoke(f, std::forward<Args>(args)...);
+            state.setValue(std::monostate{});
+        } else {
+            state.setValue(std::invoke(f, std::forward<Args>(args)...));
+        }
+    } catch(...) {
+        state.setException(std::current_exception());
+    }
+}
+
+template<typename T, typename F>
+struct ContinuationResult { using type = std::invoke_result_t<F, const T&>; };
+template<typename F>
+struct ContinuationResult<void, F> { using type = std::invoke_result_t<F>; };
+
+// Pool-native future. Unlike std::future it supports continuations: then(f)
+// schedules f on the pool as soon as this future completes, so chained steps
+// never park a worker in get(). Copies share the same state.
+template<typename T>
+class PoolFuture {
+private:
+    std::shared_ptr<PoolFutureState<T>> state;
+public:
+    using value_type = T;
+
+    PoolFuture() = default;
+    explicit PoolFuture(std::shared_ptr<PoolFutureState<T>> state) : state(std::move(state)) {}
+
+    bool valid() const { return state != nullptr; }
+    bool isReady() const { return state->isReady(); }
+    // on one of the pool's workers this runs other queued tasks until the future is
+    // ready rather than blocking, so nested waits cannot starve a small pool
+    void wait() const
+    {
+        ThreadPool* pool = state->pool;
+        if(pool && pool->isWorkerThread()) {
+            pool->helpUntil([this] { return state->isReady(); });
+        } else {
+            state->wait();
+        }
+    }
+    // waits as above, then returns the value or rethrows the task's exception
+    decltype(auto) get() const
+    {
+        wait();
+        if constexpr (std::is_void_v<T>) {
+            state->result();
+        } else {
+            return state->result();
+        }
+    }
+    const std::shared_ptr<PoolFutureState<T>>& sharedState() const { return state; }
+
+    // f receives the value (nothing for PoolFuture<void>) and runs on the pool once this
+    // future is ready; if this future failed, f is skipped and the exception carries over
+    template<typename F>
+    auto then(F&& f) const
+    {
+        using U = typename ContinuationResult<T, F>::type;
+        auto next = std::make_shared<PoolFutureState<U>>(state->pool);
+        auto run = [antecedent = state, next, f = std::forward<F>(f)]() mutable {
+            if(antecedent->failed()) {
+                next->setException(antecedent->exception());
+            } else if constexpr (std::is_void_v<T>) {
+                fulfil(*next, f);
+            } else {
+                fulfil(*next, f, antecedent->result());
+            }
+        };
+        state->onReady([pool = state->pool, next, run = std::move(run)]() mutable {
+            if(!pool) {
+                run();
+                return;
+            }
+            try {
+                pool->postUnbounded(std::move(run));
+            } catch(...) {
+                next->setException(std::current_exception()); // pool already stopped
+            }
+        });
+        return PoolFuture<U>(next);
+    }
+};
+
+// runAsync's queued work: calls fn(state) once. Should the pool destroy it unrun
+// (RejectionPolicy::DiscardOldest), the future fails with broken_promise, as a
+// submit()'s std::future would.
+template<typename R, typename Fn>
+class AsyncJob {
+private:
+    std::shared_ptr<PoolFutureState<R>> state;
+    Fn fn;
+public:
+    AsyncJob(std::shared_ptr<PoolFutureState<R>> state, Fn fn) : state(std::move(state)), fn(std::move(fn)) {}
+    AsyncJob(AsyncJob&&) = default;
+    ~AsyncJob()
+    {
+        if(state) state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+    }
+    void operator()()
+    {
+        std::shared_ptr<PoolFutureState<R>> target = std::move(state);
+        fn(*target);
+    }
+};
+
+// runs f(args...) on the pool and returns a PoolFuture for its result
+template<typename F, typename... Args>
+auto runAsync(ThreadPool& pool, F&& f, Args&&... args) -> PoolFuture<std::invoke_result_t<F, Args...>>
+{
+    using R = std::invoke_result_t<F, Args...>;
+    auto state = std::make_shared<PoolFutureState<R>>(&pool);
+    pool.post(AsyncJob(state, [call = bindTask(std::forward<F>(f), std::forward<Args>(args)...)](PoolFutureState<R>& target) mutable {
+        fulfil(target, call);
+    }));
+    return PoolFuture<R>(state);
+}
+
+template<typename T>
+PoolFuture<T> makeReadyFuture(ThreadPool* pool, typename PoolFutureState<T>::Stored value)
+{
+    auto state = std::make_shared<PoolFutureState<T>>(pool);
+    state->setValue(std::move(value));
+    return PoolFuture<T>(state);
+}
+
+// ready once every input is; holds all the values in input order, or the first
+// exception any input failed with
+template<typename T>
+auto whenAll(const std::vector<PoolFuture<T>>& futures)
+{
+    using Result = std::conditional_t<std::is_void_v<T>, void, std::vector<T>>;
+    using ResultState = PoolFutureState<Result>;
+    ThreadPool* pool = futures.empty() ? nullptr : futures.front().sharedState()->pool;
+    if(futures.empty()) {
+        return makeReadyFuture<Result>(pool, typename ResultState::Stored{});
+    }
+    struct Join {
+        std::atomic<size_t> remaining;
+        std::vector<std::shared_ptr<PoolFutureState<T>>> inputs;
+        std::shared_ptr<ResultState> result;
+    };
+    auto join = std::make_shared<Join>();
+    join->remaining.store(futures.size(), std::memory_order_relaxed);
+    join->result = std::make_shared<ResultState>(pool);
+    for(const PoolFuture<T>& future : futures) join->inputs.push_back(future.sharedState());
+    for(const auto& input : join->inputs) {
+        input->onReady([join] {
+            if(join->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+            for(const auto& in : join->inputs) {
+                if(in->failed()) {
+                    join->result->setException(in->exception());
+                    return;
+                }
+            }
+            if constexpr (std::is_void_v<T>) {
+                join->result->setValue(std::monostate{});
+            } else {
+                std::vector<T> values;
+                values.reserve(join->inputs.size());
+                for(const auto& in : join->inputs) values.push_back(in->result());
+                join->result->setValue(std::move(values));
+            }
+        });
+    }
+    return PoolFuture<Result>(join->result);
+}
+
+// ready as soon as the first input is (successfully or not), holding its index
+template<typename T>
+PoolFuture<size_t> whenAny(const std::vector<PoolFuture<T>>& futures)
+{
+    ThreadPool* pool = futures.empty() ? nullptr : futures.front().sharedState()->pool;
+    auto result = std::make_shared<PoolFutureState<size_t>>(pool);
+    if(futures.empty()) {
+        result->setException(std::make_exception_ptr(std::invalid_argument("whenAny of no futures")));
+        return PoolFuture<size_t>(result);
+    }
+    auto claimed = std::make_shared<std::atomic<bool>>(false);
+    for(size_t i = 0; i < futures.size(); ++i) {
+        futures[i].sharedState()->onReady([result, claimed, i] {
+            if(!claimed->exchange(true, std::memory_order_acq_rel)) result->setValue(i);
+        });
+    }
+    return PoolFuture<size_t>(result);
+}
@@ -0,0 +1,155 @@
+// Checks the order the pool picks work in and what it skips: priority lanes, dequeue
+// batching, earliest-deadline-first, expired deadlines and cancellation tokens.
+// Build: g++ -std=c++17 -O2 -pthread SchedulingTest.cpp -o SchedulingTest
+#include "CancellationToken.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+// records the order tasks started in
+class StartOrder {
+private:
+    std::mutex mtx;
+    std::vector<int> order;
+public:
+    void add(int id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        order.push_back(id);
+    }
+    std::vector<int> get() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return order;
+    }
+};
+
+int main() {
+    runCase("High work starts before Low work on every worker", [] {
+        ThreadPoolOptions options;
+        options.numThreads = 2;
+        ThreadPool pool(options);
+        StartOrder order;
+        BusyWorker first(pool), second(pool);
+        constexpr int Count = 32;
+        for (int i = 0; i < Count; ++i) {
+            pool.post(TaskPriority::High, [&order] {
+                order.add(1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            });
+        }
+        for (int i = 0; i < Count; ++i) pool.post(TaskPriority::Low, [&order] { order.add(2); });
+        first.release();
+        second.release();
+        bool finished = eventually([&] { return order.get().size() == 2 * Count; });
+        pool.shutdown();
+        std::vector<int> started = order.get();
+        return finished && std::is_sorted(started.begin(), started.end());
+    });
+    runCase("EDF runs deadline tasks earliest first, ahead of plain submits", [] {
+        ThreadPoolOptions options;
+        options.numThreads = 1;
+        options.schedulingPolicy = SchedulingPolicy::EarliestDeadlineFirst;
+        ThreadPool pool(options);
+        StartOrder order;
+        BusyWorker busy(pool);
+        pool.post([&order] { order.add(4); });
+        auto now = std::chrono::steady_clock::now();
+        pool.submitWithDeadline(now + seconds(30), [&order] { order.add(3); });
+        pool.submitWithDeadline(now + seconds(10), [&order] { order.add(1); });
+        pool.submitWithDeadline(now + seconds(20), [&order] { order.add(2); });
+        busy.release();
+        bool finished = eventually([&] { return order.get().size() == 4; });
+        pool.shutdown();
+        return finished && order.get() == std::vector<int>{1, 2, 3, 4};
+    });
+    for (SchedulingPolicy scheduling : {SchedulingPolicy::Fifo, SchedulingPolicy::EarliestDeadlineFirst}) {
+        runCase(std::string("an expired deadline task is dropped under ExpiredTaskPolicy::Drop, ")
+                    + (scheduling == SchedulingPolicy::Fifo ? "Fifo" : "EDF"), [scheduling] {
+            ThreadPoolOptions options;
+            options.numThreads = 1;
+            options.schedulingPolicy = scheduling;
+            options.expiredTaskPolicy = ExpiredTaskPolicy::Drop;
+            ThreadPool pool(options);
+            std::atomic<bool> ran{false};
+            BusyWorker busy(pool);
+            std::future<void> late = pool.submitWithTimeout(milliseconds(1), [&ran] { ran = true; });
+            std::future<int> onTime = pool.submitWithTimeout(seconds(30), [] { return 1; });
+            std::this_thread::sleep_for(milliseconds(20));
+            busy.release();
+            bool dropped = false;
+            try {
+                late.get();
+            } catch (const TaskExpired&) {
+                dropped = true;
+            }
+            bool kept = onTime.get() == 1;
+            pool.shutdown();
+            return dropped && kept && !ran && pool.expiredTaskCount() == 1;
+        });
+    }
+    runCase("an expired deadline task still runs under ExpiredTaskPolicy::Run", [] {
+        ThreadPoolOptions options;
+        options.numThreads = 1;
+        ThreadPool pool(options);
+        BusyWorker busy(pool);
+        std::future<int> late = pool.submitWithTimeout(milliseconds(1), [] { return 1; });
+        std::this_thread::sleep_for(milliseconds(20));
+        busy.release();
+        bool ran = late.get() == 1;
+        pool.shutdown();
+        return ran && pool.expiredTaskCount() == 1;
+    });
+    runCase("tasks whose token is cancelled while queued are skipped", [] {
+        ThreadPool pool(1);
+        CancellationSource source;
+        std::atomic<int> ran{0};
+        BusyWorker busy(pool);
+        std::future<int> submitted = pool.submit(source.token(), [&ran] { return ++ran; });
+        pool.post(source.token(), [&ran] { ++ran; });
+        std::future<int> other = pool.submit(CancellationSource().token(), [] { return 7; });
+        source.cancel();
+        busy.release();
+        bool skipped = false;
+        try {
+            submitted.get();
+        } catch (const TaskCancelled&) {
+            skipped = true;
+        }
+        bool unaffected = other.get() == 7;
+        pool.shutdown();
+        return skipped && unaffected && ran == 0 && pool.cancelledTaskCount() == 2;
+    });
+    runCase("a running task sees its token cancelled", [] {
+        ThreadPool pool(1);
+        CancellationSource source;
+        std::atomic<bool> started{false};
+        std::future<void> running = pool.submit(source.token(), [&started](CancellationToken token) {
+            started = true;
+            while (true) {
+                token.throwIfCancelled();
+                std::this_thread::yield();
+            }
+        }, source.token());
+        while (!started) std::this_thread::yield();
+        source.cancel();
+        bool stopped = false;
+        try {
+            running.get();
+        } catch (const TaskCancelled&) {
+            stopped = true;
+        }
+        pool.shutdown();
+        return stopped && pool.cancelledTaskCount() == 0;
+    });
+
+    return finish();
+}
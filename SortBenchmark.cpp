@@ -0,0 +1,60 @@
+// Compares parallelSort / parallelInclusiveScan with their std counterparts.
+// Build: g++ -std=c++17 -O2 -pthread SortBenchmark.cpp -o SortBenchmark
+// Usage: SortBenchmark [elements] [threads]
+#include "Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+template<typename F>
+double timeMs(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<uint64_t> randomData(size_t n) {
+    std::mt19937_64 gen(42);
+    std::vector<uint64_t> data(n);
+    for (auto& x : data) x = gen();
+    return data;
+}
+
+void report(const std::string& name, double stdMs, double poolMs, bool same) {
+    std::cout << std::left << std::setw(8) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << "  std: " << std::setw(9) << stdMs << " ms"
+              << "  pool: " << std::setw(9) << poolMs << " ms"
+              << "  speedup: " << std::setprecision(2) << stdMs / poolMs << "x"
+              << (same ? "" : "  MISMATCH") << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000000;
+    size_t threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+    ThreadPool pool(threads);
+    std::cout << n << " elements, " << pool.size() << " threads\n";
+
+    const std::vector<uint64_t> input = randomData(n);
+
+    std::vector<uint64_t> expected = input;
+    double stdSort = timeMs([&] { std::sort(expected.begin(), expected.end()); });
+    std::vector<uint64_t> sorted = input;
+    double poolSort = timeMs([&] { parallelSort(pool, sorted.begin(), sorted.end()); });
+    report("sort", stdSort, poolSort, sorted == expected);
+
+    std::vector<uint64_t> stdOut(n), poolOut(n);
+    double stdScan = timeMs([&] { std::inclusive_scan(input.begin(), input.end(), stdOut.begin()); });
+    double poolScan = timeMs([&] { parallelInclusiveScan(pool, input.begin(), input.end(), poolOut.begin()); });
+    report("scan", stdScan, poolScan, poolOut == stdOut);
+
+    pool.shutdown();
+    return 0;
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+// runs a drained batch in order; an exception does not stop the strand, it is handed
+// to the pool's exception handler like one escaping any posted task
+inline void runSerialBatch(ThreadPool& pool, std::vector<Task>& batch)
+{
+    for(Task& task : batch) {
+        try {
+            task();
+        } catch(...) {
+            pool.reportException(std::current_exception());
+        }
+    }
+    batch.clear();
+}
+
+// Serial executor on a ThreadPool: tasks run in submission order, one at a time,
+// without ever blocking a worker on a mutex. The queue is drained by a single
+// pool task that runs up to maxBatch tasks back to back, then re-posts itself if
+// more arrived, so a busy strand still lets other work through. The destructor
+// waits until the strand is idle.
+class Strand {
+private:
+    ThreadPool& pool;
+    const size_t maxBatch;
+    std::mutex mtx;
+    std::deque<Task> queue;
+    bool scheduled = false; // a drain task is queued or running
+    std::vector<Task> batch; // only touched by the drain task, there is at most one
+
+    // first post of an idle strand
+    void schedule()
+    {
+        try {
+            pool.postUnbounded([this] { drain(); });
+        } catch(...) {
+            // the pool is stopped: nothing queued here can run any more
+            std::deque<Task> dropped;
+            std::lock_guard<std::mutex> lock(mtx);
+            dropped.swap(queue);
+            scheduled = false;
+            throw;
+        }
+    }
+    void drain()
+    {
+        while(true) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                size_t take = std::min(maxBatch, queue.size());
+                for(size_t i = 0; i < take; ++i) {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+            runSerialBatch(pool, batch);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if(queue.empty()) {
+                    scheduled = false;
+                    return;
+                }
+            }
+            try {
+                pool.requeue([this] { drain(); }); // back of the line, other work gets a turn
+                return;
+            } catch(const std::runtime_error&) {
+                // the pool is stopping (we are helping from outside it): finish here
+            }
+        }
+    }
+    void enqueue(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queue.push_back(std::move(task));
+            if(scheduled) return;
+            scheduled = true;
+        }
+        schedule();
+    }
+public:
+    explicit Strand(ThreadPool& pool, size_t maxBatch = 64) : pool(pool), maxBatch(std::max<size_t>(maxBatch, 1)) {}
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+    ~Strand() { wait(); }
+
+    template<typename F, typename... Args>
+    void post(F&& f, Args&&... args)
+    {
+        enqueue(Task(bindTask(std::forward<F>(f), std::forward<Args>(args)...)));
+    }
+    template<typename F, typename... Args>
+    auto submit(F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        std::future<std::invoke_result_t<F, Args...>> res;
+        enqueue(Task(makePackagedTask(res, std::forward<F>(f), std::forward<Args>(args)...)));
+        return res;
+    }
+    bool idle()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return !scheduled;
+    }
+    // helps the pool until everything posted so far has run
+    void wait()
+    {
+        pool.helpUntil([this] { return idle(); });
+    }
+};
+
+// Many strands keyed by Key (a user id, a shard, ...): tasks with equal keys run in
+// submission order and never concurrently, different keys run in parallel. A key's
+// queue exists only while it has work, so idle keys cost nothing. Keys are spread
+// over independently locked shards so unrelated keys rarely contend.
+template<typename Key, typename Hash = std::hash<Key>>
+class KeyedExecutor {
+private:
+    static constexpr size_t ShardCount = 32;
+    struct Entry {
+        std::deque<Task> queue; // the key's drain task is queued or running while this exists
+    };
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        std::unordered_map<Key, Entry, Hash> keys;
+    };
+    ThreadPool& pool;
+    const size_t maxBatch;
+    Hash hash;
+    std::array<Shard, ShardCount> shards;
+    std::atomic<size_t> activeKeys{0};
+
+    Shard& shardOf(const Key& key) { return shards[hash(key) % ShardCount]; }
+    // node pointers of an unordered_map stay valid until the node is erased, and only
+    // the key's own drain task erases it
+    void schedule(Shard& shard, typename std::unordered_map<Key, Entry, Hash>::value_type* node)
+    {
+        pool.postUnbounded([this, &shard, node] { drain(shard, node); });
+    }
+    void drain(Shard& shard, typename std::unordered_map<Key, Entry, Hash>::value_type* node)
+    {
+        std::vector<Task> batch;
+        while(true) {
+            {
+                std::lock_guard<std::mutex> lock(shard.mtx);
+                std::deque<Task>& queue = node->second.queue;
+                size_t take = std::min(maxBatch, queue.size());
+                for(size_t i = 0; i < take; ++i) {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+            runSerialBatch(pool, batch);
+            bool finished = false;
+            {
+                std::lock_guard<std::mutex> lock(shard.mtx);
+                if(node->second.queue.empty()) {
+                    shard.keys.erase(shard.keys.find(node->first));
+                    finished = true;
+                }
+            }
+            if(finished) {
+                activeKeys.fetch_sub(1, std::memory_order_acq_rel); // last access to the executor
+                return;
+            }
+            try {
+                pool.requeue([this, &shard, node] { drain(shard, node); }); // back of the line, other keys get a turn
+                return;
+            } catch(const std::runtime_error&) {
+                // the pool is stopping (we are helping from outside it): finish here
+            }
+        }
+    }
+    void enqueue(const Key& key, Task task)
+    {
+        Shard& shard = shardOf(key);
+        typename std::unordered_map<Key, Entry, Hash>::value_type* node;
+        {
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            auto [it, inserted] = shard.keys.try_emplace(key);
+            it->second.queue.push_back(std::move(task));
+            if(!inserted) return; // the key's drain task will get to it
+            activeKeys.fetch_add(1, std::memory_order_relaxed);
+            node = &*it;
+        }
+        try {
+            schedule(shard, node);
+        } catch(...) {
+            // the pool is stopped: drop the key's queue
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            shard.keys.erase(shard.keys.find(node->first));
+            activeKeys.fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+    }
+public:
+    explicit KeyedExecutor(ThreadPool& pool, size_t maxBatch = 64, Hash hash = Hash())
+        : pool(pool), maxBatch(std::max<size_t>(maxBatch, 1)), hash(std::move(hash)) {}
+    KeyedExecutor(const KeyedExecutor&) = delete;
+    KeyedExecutor& operator=(const KeyedExecutor&) = delete;
+    ~KeyedExecutor() { wait(); }
+
+    template<typename F, typename... Args>
+    void post(const Key& key, F&& f, Args&&... args)
+    {
+        enqueue(key, Task(bindTask(std::forward<F>(f), std::forward<Args>(args)...)));
+    }
+    template<typename F, typename... Args>
+    auto submit(const Key& key, F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        std::future<std::invoke_result_t<F, Args...>> res;
+        enqueue(key, Task(makePackagedTask(res, std::forward<F>(f), std::forward<Args>(args)...)));
+        return res;
+    }
+    // keys that currently have queued or running tasks
+    size_t activeKeyCount() const { return activeKeys.load(std::memory_order_relaxed); }
+    // helps the pool until every key's queue has drained
+    void wait()
+    {
+        pool.helpUntil([this] { return activeKeys.load(std::memory_order_acquire) == 0; });
+    }
+};
@@ -0,0 +1,86 @@
+// Checks that a busy Strand or KeyedExecutor key takes turns with other work on a
+// one-worker pool instead of monopolizing it, from outside the pool and from a task.
+// Build: g++ -std=c++17 -O2 -pthread StrandTest.cpp -o StrandTest
+#include "Strand.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// records the order tasks ran in
+class RunOrder {
+private:
+    std::mutex mtx;
+    std::vector<int> order;
+public:
+    void add(int id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        order.push_back(id);
+    }
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return order.size();
+    }
+    // where id ran, or size() if it did not
+    size_t position(int id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t i = 0;
+        while (i < order.size() && order[i] != id) ++i;
+        return i;
+    }
+};
+
+constexpr int Hot = 100;
+
+int main() {
+    runCase("strand lets an earlier outside post through", [] {
+        ThreadPool pool(1);
+        RunOrder order;
+        Strand strand(pool, 1);
+        BusyWorker busy(pool);
+        pool.post([&order] { order.add(-1); });
+        for (int i = 0; i < Hot; ++i) strand.post([&order, i] { order.add(i); });
+        busy.release();
+        bool finished = eventually([&] { return order.size() == Hot + 1; });
+        pool.shutdown();
+        return finished && order.position(-1) <= 1;
+    });
+    runCase("strand lets an earlier post from a task through", [] {
+        ThreadPool pool(1);
+        RunOrder order;
+        Strand strand(pool, 1);
+        pool.post([&] {
+            pool.post([&order] { order.add(-1); });
+            for (int i = 0; i < Hot; ++i) strand.post([&order, i] { order.add(i); });
+        });
+        bool finished = eventually([&] { return order.size() == Hot + 1; });
+        pool.shutdown();
+        return finished && order.position(-1) <= 1;
+    });
+    runCase("KeyedExecutor hot key lets another key through", [] {
+        ThreadPool pool(1);
+        RunOrder order;
+        KeyedExecutor<int> executor(pool, 1);
+        pool.post([&] {
+            executor.post(2, [&order] { order.add(-1); });
+            for (int i = 0; i < Hot; ++i) executor.post(1, [&order, i] { order.add(i); });
+        });
+        bool finished = eventually([&] { return order.size() == Hot + 1; });
+        pool.shutdown();
+        return finished && order.position(-1) <= 1;
+    });
+    runCase("strand still runs in order", [] {
+        ThreadPool pool(4);
+        RunOrder order;
+        Strand strand(pool, 3);
+        for (int i = 0; i < 1000; ++i) strand.post([&order, i] { order.add(i); });
+        strand.wait();
+        bool ordered = true;
+        for (int i = 0; i < 1000; ++i) ordered = ordered && order.position(i) == static_cast<size_t>(i);
+        pool.shutdown();
+        return ordered;
+    });
+
+    return finish();
+}
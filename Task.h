@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only, type-erased void() callable used as the pool's unit of work.
+// Callables that fit in InlineSize bytes (a lambda capturing a few values, a
+// packaged_task, ...) live inside the Task itself, so queueing one never
+// allocates. Larger callables fall back to a single heap allocation.
+class Task {
+public:
+    static constexpr size_t InlineSize = 48;
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*relocate)(void* from, void* to); // move into `to`, then destroy `from`
+        void (*destroy)(void* storage);
+    };
+
+    template<typename F>
+    static constexpr bool fitsInline = sizeof(F) <= InlineSize
+        && alignof(F) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible_v<F>;
+
+    template<typename F>
+    struct InlineOps {
+        static void invoke(void* storage) { (*std::launder(static_cast<F*>(storage)))(); }
+        static void relocate(void* from, void* to)
+        {
+            F* src = std::launder(static_cast<F*>(from));
+            ::new (to) F(std::move(*src));
+            src->~F();
+        }
+        static void destroy(void* storage) { std::launder(static_cast<F*>(storage))->~F(); }
+        static constexpr Ops ops{&invoke, &relocate, &destroy};
+    };
+
+    template<typename F>
+    struct HeapOps {
+        static F*& ptr(void* storage) { return *std::launder(static_cast<F**>(storage)); }
+        static void invoke(void* storage) { (*ptr(storage))(); }
+        static void relocate(void* from, void* to) { ::new (to) F*(ptr(from)); }
+        static void destroy(void* storage) { delete ptr(storage); }
+        static constexpr Ops ops{&invoke, &relocate, &destroy};
+    };
+
+    alignas(std::max_align_t) unsigned char storage[InlineSize];
+    const Ops* ops = nullptr;
+
+    void reset()
+    {
+        if(ops) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+public:
+    Task() = default;
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& f)
+    {
+        using Fn = std::decay_t<F>;
+        if constexpr (fitsInline<Fn>) {
+            ::new (static_cast<void*>(storage)) Fn(std::forward<F>(f));
+            ops = &InlineOps<Fn>::ops;
+        } else {
+            ::new (static_cast<void*>(storage)) Fn*(new Fn(std::forward<F>(f)));
+            ops = &HeapOps<Fn>::ops;
+        }
+    }
+    Task(Task&& other) noexcept
+    {
+        if(other.ops) {
+            other.ops->relocate(other.storage, storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+    Task& operator=(Task&& other) noexcept
+    {
+        if(this != &other) {
+            reset();
+            if(other.ops) {
+                other.ops->relocate(other.storage, storage);
+                ops = other.ops;
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { reset(); }
+
+    void operator()() { ops->invoke(storage); }
+    explicit operator bool() const { return ops != nullptr; }
+};
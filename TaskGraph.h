@@ -0,0 +1,155 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+// Static DAG of tasks, declared once and run on a ThreadPool any number of
+// times. Every node keeps an atomic count of unfinished predecessors; the
+// predecessor that brings it to zero makes it ready, so no task ever blocks on
+// another. Node state is allocated while the graph is built and only reset
+// between runs.
+class TaskGraph {
+public:
+    using NodeId = size_t;
+private:
+    struct Node {
+        Task work; // called once per run, never consumed
+        std::vector<NodeId> successors;
+        size_t predecessors = 0;
+        std::atomic<size_t> pending{0}; // predecessors not finished in the current run
+    };
+    std::deque<Node> nodes; // a deque so Node (which holds an atomic) never has to move
+    std::vector<NodeId> roots;
+    bool validated = false;
+    std::atomic<bool> running{false};
+    std::atomic<size_t> remaining{0}; // nodes of the current run that have not finished
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex errorMtx;
+
+    // Kahn's algorithm: every node must become ready exactly once
+    void validate()
+    {
+        std::vector<size_t> pending(nodes.size());
+        std::vector<NodeId> ready;
+        roots.clear();
+        for(NodeId id = 0; id < nodes.size(); ++id) {
+            pending[id] = nodes[id].predecessors;
+            if(pending[id] == 0) roots.push_back(id);
+        }
+        ready = roots;
+        size_t visited = 0;
+        while(!ready.empty()) {
+            NodeId id = ready.back();
+            ready.pop_back();
+            ++visited;
+            for(NodeId next : nodes[id].successors) {
+                if(--pending[next] == 0) ready.push_back(next);
+            }
+        }
+        if(visited != nodes.size()) throw std::logic_error("TaskGraph has a cycle");
+        validated = true;
+    }
+    void spawn(ThreadPool& pool, NodeId id)
+    {
+        try {
+            pool.postUnbounded([this, &pool, id] { execute(pool, id); });
+        } catch(const std::runtime_error&) {
+            // the pool stopped mid-run; its workers still drain what is queued, and
+            // this node runs here so the run can finish
+            execute(pool, id);
+        }
+    }
+    // Runs the node, then releases its successors. The last successor made ready
+    // runs right here instead of going through the queue, so a chain of nodes
+    // costs no enqueue/dequeue round trips.
+    void execute(ThreadPool& pool, NodeId id)
+    {
+        while(true) {
+            Node& node = nodes[id];
+            if(!failed.load(std::memory_order_relaxed)) {
+                try {
+                    node.work();
+                } catch(...) {
+                    // later nodes are still counted down, but none of them run
+                    std::lock_guard<std::mutex> lock(errorMtx);
+                    if(!error) error = std::current_exception();
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            const NodeId none = nodes.size();
+            NodeId next = none;
+            for(NodeId successor : node.successors) {
+                if(nodes[successor].pending.fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+                if(next != none) spawn(pool, next);
+                next = successor;
+            }
+            // the graph must not be touched after the final decrement, run() may return
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+            if(next == none) return;
+            id = next;
+        }
+    }
+public:
+    TaskGraph() = default;
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    // f is called with no arguments once per run; it is kept between runs
+    template<typename F>
+    NodeId add(F&& f)
+    {
+        if(running) throw std::logic_error("TaskGraph modified while running");
+        Node& node = nodes.emplace_back();
+        node.work = Task(std::forward<F>(f));
+        validated = false;
+        return nodes.size() - 1;
+    }
+    // `after` starts only once `before` has finished
+    void precede(NodeId before, NodeId after)
+    {
+        if(running) throw std::logic_error("TaskGraph modified while running");
+        if(before >= nodes.size() || after >= nodes.size()) throw std::out_of_range("TaskGraph node id");
+        nodes[before].successors.push_back(after);
+        ++nodes[after].predecessors;
+        validated = false;
+    }
+    size_t size() const { return nodes.size(); }
+
+    // Runs every node on the pool and returns when all have finished; the calling
+    // thread helps with queued work meanwhile. If a node throws, nodes that have
+    // not started yet are skipped and the first exception is rethrown here.
+    // Throws std::logic_error if the edges form a cycle.
+    void run(ThreadPool& pool)
+    {
+        if(running.exchange(true)) throw std::logic_error("TaskGraph is already running");
+        try {
+            if(!validated) validate();
+        } catch(...) {
+            running = false;
+            throw;
+        }
+        error = nullptr;
+        failed.store(false, std::memory_order_relaxed);
+        for(Node& node : nodes) node.pending.store(node.predecessors, std::memory_order_relaxed);
+        remaining.store(nodes.size(), std::memory_order_release);
+        if(!roots.empty()) {
+            try {
+                pool.postUnbounded([this, &pool, root = roots.front()] { execute(pool, root); });
+            } catch(...) {
+                running = false; // the pool is stopped, nothing has run
+                throw;
+            }
+            for(size_t i = 1; i < roots.size(); ++i) spawn(pool, roots[i]);
+            pool.helpUntil([this] { return remaining.load(std::memory_order_acquire) == 0; });
+        }
+        running = false;
+        if(error) std::rethrow_exception(error);
+    }
+};
@@ -0,0 +1,133 @@
+// Checks that a TaskGraph can be run again and again: every node once per run in
+// dependency order, after a failed run, after growing, and from inside a task.
+// Build: g++ -std=c++17 -O2 -pthread TaskGraphTest.cpp -o TaskGraphTest
+#include "TaskGraph.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// a diamond a -> {b, c} -> d that logs each node as it runs
+class Diamond {
+private:
+    std::mutex mtx;
+    std::vector<char> log;
+public:
+    TaskGraph graph;
+    TaskGraph::NodeId a, b, c, d;
+    std::atomic<bool> failB{false};
+
+    Diamond() {
+        a = graph.add([this] { record('a'); });
+        b = graph.add([this] {
+            if (failB.exchange(false)) throw std::runtime_error("b failed");
+            record('b');
+        });
+        c = graph.add([this] { record('c'); });
+        d = graph.add([this] { record('d'); });
+        graph.precede(a, b);
+        graph.precede(a, c);
+        graph.precede(b, d);
+        graph.precede(c, d);
+    }
+    void record(char node) {
+        std::lock_guard<std::mutex> lock(mtx);
+        log.push_back(node);
+    }
+    // the log of the run since the last call, cleared
+    std::vector<char> take() {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<char> run;
+        run.swap(log);
+        return run;
+    }
+    // one full run in a valid order
+    bool ranOnce() {
+        std::vector<char> run = take();
+        if (run.size() != 4 || run.front() != 'a' || run.back() != 'd') return false;
+        std::sort(run.begin(), run.end());
+        return run == std::vector<char>{'a', 'b', 'c', 'd'};
+    }
+};
+
+int main() {
+    runCase("a graph reruns every node once per run, in order", [] {
+        ThreadPool pool(4);
+        Diamond diamond;
+        bool ok = true;
+        for (int run = 0; run < 50 && ok; ++run) {
+            diamond.graph.run(pool);
+            ok = diamond.ranOnce();
+        }
+        pool.shutdown();
+        return ok;
+    });
+    runCase("a graph reruns cleanly after a failed run", [] {
+        ThreadPool pool(2);
+        Diamond diamond;
+        diamond.failB = true;
+        bool thrown = false;
+        try {
+            diamond.graph.run(pool);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        std::vector<char> failed = diamond.take();
+        bool skipped = std::find(failed.begin(), failed.end(), 'd') == failed.end();
+        diamond.graph.run(pool);
+        bool rerun = diamond.ranOnce();
+        pool.shutdown();
+        return thrown && skipped && rerun;
+    });
+    runCase("a graph grown between runs runs the new nodes too", [] {
+        ThreadPool pool(2);
+        Diamond diamond;
+        diamond.graph.run(pool);
+        bool first = diamond.ranOnce();
+        TaskGraph::NodeId e = diamond.graph.add([&diamond] { diamond.record('e'); });
+        diamond.graph.precede(diamond.d, e);
+        diamond.graph.run(pool);
+        std::vector<char> run = diamond.take();
+        pool.shutdown();
+        return first && run.size() == 5 && run.back() == 'e';
+    });
+    runCase("a cyclic graph throws on every run", [] {
+        ThreadPool pool(1);
+        TaskGraph graph;
+        TaskGraph::NodeId x = graph.add([] {});
+        TaskGraph::NodeId y = graph.add([] {});
+        graph.precede(x, y);
+        graph.precede(y, x);
+        int thrown = 0;
+        for (int run = 0; run < 2; ++run) {
+            try {
+                graph.run(pool);
+            } catch (const std::logic_error&) {
+                ++thrown;
+            }
+        }
+        pool.shutdown();
+        return thrown == 2;
+    });
+    runCase("a graph reruns from inside a task on a one-worker pool", [] {
+        ThreadPool pool(1);
+        Diamond diamond;
+        std::future<bool> nested = pool.submit([&pool, &diamond] {
+            bool ok = true;
+            for (int run = 0; run < 10 && ok; ++run) {
+                diamond.graph.run(pool);
+                ok = diamond.ranOnce();
+            }
+            return ok;
+        });
+        bool ok = nested.get();
+        pool.shutdown();
+        return ok;
+    });
+
+    return finish();
+}
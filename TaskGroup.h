@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+// how a TaskGroup reports children that threw
+enum class GroupErrorPolicy {
+    First, // the first exception cancels the rest of the group and wait() rethrows it
+    All    // every child still runs; wait() throws TaskGroupErrors holding all exceptions
+};
+
+// thrown by TaskGroup::wait() under GroupErrorPolicy::All
+class TaskGroupErrors : public std::runtime_error {
+private:
+    std::vector<std::exception_ptr> errors;
+public:
+    explicit TaskGroupErrors(std::vector<std::exception_ptr> errors)
+        : std::runtime_error("TaskGroup children failed"), errors(std::move(errors)) {}
+    const std::vector<std::exception_ptr>& exceptions() const { return errors; }
+};
+
+// Fork-join scope over a ThreadPool. Children are posted to the pool and
+// joined through one atomic counter, so spawning one costs no future and no
+// shared state. wait() runs queued work while it waits, so a group may be
+// waited on from inside a pool task. The destructor waits as well: children
+// never outlive the group.
+class TaskGroup {
+private:
+    ThreadPool& pool;
+    const GroupErrorPolicy errorPolicy;
+    std::atomic<size_t> outstanding{0};
+    std::atomic<bool> cancelled{false};
+    std::vector<std::exception_ptr> errors;
+    std::mutex errorMtx;
+
+    void fail(std::exception_ptr error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(errorMtx);
+            errors.push_back(std::move(error));
+        }
+        if(errorPolicy == GroupErrorPolicy::First) cancel();
+    }
+    void join()
+    {
+        pool.helpUntil([this] { return outstanding.load(std::memory_order_acquire) == 0; });
+    }
+public:
+    explicit TaskGroup(ThreadPool& pool, GroupErrorPolicy errorPolicy = GroupErrorPolicy::First)
+        : pool(pool), errorPolicy(errorPolicy) {}
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    // waits for the children; their exceptions are dropped
+    ~TaskGroup() { join(); }
+
+    // posts f(args...) as a child. Nothing is posted once the group is cancelled,
+    // and a child that is still queued when it is cancelled never runs. Children
+    // go through postUnbounded(), so a full bounded queue neither blocks run() nor
+    // drops a child the group is counting on.
+    template<typename F, typename... Args>
+    void run(F&& f, Args&&... args)
+    {
+        if(isCancelled()) return;
+        outstanding.fetch_add(1, std::memory_order_relaxed);
+        try {
+            pool.postUnbounded([this, call = bindTask(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+                if(!isCancelled()) {
+                    try {
+                        call();
+                    } catch(...) {
+                        fail(std::current_exception());
+                    }
+                }
+                outstanding.fetch_sub(1, std::memory_order_acq_rel); // last access to the group
+            });
+        } catch(...) {
+            outstanding.fetch_sub(1, std::memory_order_relaxed);
+            throw;
+        }
+    }
+    // cooperative: queued children are skipped, running ones can poll isCancelled()
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+    size_t outstandingTasks() const { return outstanding.load(std::memory_order_relaxed); }
+
+    // Returns once every child has finished or been skipped, then reports failures
+    // according to the error policy. Afterwards the group is empty and uncancelled
+    // and can be reused.
+    void wait()
+    {
+        join();
+        std::vector<std::exception_ptr> failed;
+        {
+            std::lock_guard<std::mutex> lock(errorMtx);
+            failed.swap(errors);
+        }
+        cancelled.store(false, std::memory_order_relaxed);
+        if(failed.empty()) return;
+        if(errorPolicy == GroupErrorPolicy::First) std::rethrow_exception(failed.front());
+        throw TaskGroupErrors(std::move(failed));
+    }
+};
@@ -0,0 +1,224 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include "Task.h"
+
+// Shared (injection) queue backend used by ThreadPool for submits coming from
+// outside the pool. Implementations must be safe for any number of producers
+// and consumers.
+class TaskQueue {
+public:
+    virtual ~TaskQueue() = default;
+    // pushes the task and returns true, or leaves it untouched and returns false when full
+    virtual bool tryPush(Task& task) = 0;
+    // pushes tasks from the front of [first, last) until full, returns how many were taken
+    virtual size_t tryPushBulk(Task* first, Task* last) = 0;
+    virtual bool tryPop(Task& out) = 0;
+    // appends up to max tasks to out, returns how many were popped
+    virtual size_t tryPopBulk(std::vector<Task>& out, size_t max) = 0;
+    // approximate, may be stale by the time it is read
+    virtual size_t size() const = 0;
+    // 0 for unbounded queues
+    virtual size_t capacity() const = 0;
+};
+
+// Unbounded FIFO behind a mutex.
+class LockedTaskQueue : public TaskQueue {
+private:
+    std::queue<Task> tasks;
+    mutable std::mutex mtx;
+    std::atomic<size_t> count{0};
+public:
+    bool tryPush(Task& task) override
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push(std::move(task));
+        count.store(tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+    size_t tryPushBulk(Task* first, Task* last) override
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for(Task* it = first; it != last; ++it) tasks.push(std::move(*it));
+        count.store(tasks.size(), std::memory_order_relaxed);
+        return last - first;
+    }
+    bool tryPop(Task& out) override
+    {
+        if(count.load(std::memory_order_relaxed) == 0) return false;
+        std::lock_guard<std::mutex> lock(mtx);
+        if(tasks.empty()) return false;
+        out = std::move(tasks.front());
+        tasks.pop();
+        count.store(tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+    size_t tryPopBulk(std::vector<Task>& out, size_t max) override
+    {
+        if(count.load(std::memory_order_relaxed) == 0) return 0;
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t n = 0;
+        for(; n < max && !tasks.empty(); ++n) {
+            out.push_back(std::move(tasks.front()));
+            tasks.pop();
+        }
+        count.store(tasks.size(), std::memory_order_relaxed);
+        return n;
+    }
+    size_t size() const override { return count.load(std::memory_order_relaxed); }
+    size_t capacity() const override { return 0; }
+};
+
+// Fixed-capacity lock-free MPMC ring (Dmitry Vyukov's bounded queue). Every
+// cell carries a sequence number telling producers and consumers whose turn it
+// is, so a push or pop is one CAS on the shared position plus one store on the
+// cell. All memory is allocated up front; pushing never allocates.
+class BoundedTaskQueue : public TaskQueue {
+private:
+    static constexpr size_t CacheLine = 64;
+    struct alignas(CacheLine) Cell {
+        std::atomic<size_t> sequence;
+        Task task;
+    };
+    std::unique_ptr<Cell[]> cells;
+    const size_t mask;
+    alignas(CacheLine) std::atomic<size_t> enqueuePos{0};
+    alignas(CacheLine) std::atomic<size_t> dequeuePos{0};
+
+    static size_t roundUpPow2(size_t n)
+    {
+        size_t p = 2;
+        while(p < n) p <<= 1;
+        return p;
+    }
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedTaskQueue(size_t capacity)
+        : cells(new Cell[roundUpPow2(capacity)]), mask(roundUpPow2(capacity) - 1)
+    {
+        for(size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    bool tryPush(Task& task) override
+    {
+        Cell* cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(dif == 0) {
+                if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if(dif < 0) {
+                return false; // full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->task = std::move(task);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    size_t tryPushBulk(Task* first, Task* last) override
+    {
+        size_t n = 0;
+        for(Task* it = first; it != last && tryPush(*it); ++it) ++n;
+        return n;
+    }
+    bool tryPop(Task& out) override
+    {
+        Cell* cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(dif == 0) {
+                if(dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if(dif < 0) {
+                return false; // empty
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        out = std::move(cell->task);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+    size_t tryPopBulk(std::vector<Task>& out, size_t max) override
+    {
+        size_t n = 0;
+        Task task;
+        while(n < max && tryPop(task)) {
+            out.push_back(std::move(task));
+            ++n;
+        }
+        return n;
+    }
+    size_t size() const override
+    {
+        size_t head = dequeuePos.load(std::memory_order_relaxed);
+        size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+    size_t capacity() const override { return mask + 1; }
+};
+
+// Earliest-deadline-first queue: a binary heap ordered by deadline, ties broken
+// by submission order. A capacity of 0 leaves it unbounded.
+class DeadlineTaskQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+private:
+    struct Entry {
+        Clock::time_point deadline;
+        uint64_t seq;
+        Task task;
+    };
+    struct Later {
+        bool operator()(const Entry& a, const Entry& b) const
+        {
+            return a.deadline != b.deadline ? a.deadline > b.deadline : a.seq > b.seq;
+        }
+    };
+    std::vector<Entry> heap;
+    uint64_t nextSeq = 0;
+    mutable std::mutex mtx;
+    std::atomic<size_t> count{0};
+    const size_t limit;
+public:
+    explicit DeadlineTaskQueue(size_t capacity = 0) : limit(capacity) {}
+
+    // pushes the task and returns true, or leaves it untouched and returns false when full
+    bool tryPush(Task& task, Clock::time_point deadline)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(limit > 0 && heap.size() >= limit) return false;
+        heap.push_back(Entry{deadline, nextSeq++, std::move(task)});
+        std::push_heap(heap.begin(), heap.end(), Later());
+        count.store(heap.size(), std::memory_order_relaxed);
+        return true;
+    }
+    // pops the task with the earliest deadline
+    bool tryPop(Task& out)
+    {
+        if(count.load(std::memory_order_relaxed) == 0) return false;
+        std::lock_guard<std::mutex> lock(mtx);
+        if(heap.empty()) return false;
+        std::pop_heap(heap.begin(), heap.end(), Later());
+        out = std::move(heap.back().task);
+        heap.pop_back();
+        count.store(heap.size(), std::memory_order_relaxed);
+        return true;
+    }
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+    size_t capacity() const { return limit; }
+};
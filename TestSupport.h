@@ -0,0 +1,64 @@
+#pragma once
+// Shared helpers for the standalone *Test.cpp programs: each case runs with a hang
+// guard and prints one ok/FAIL line; main returns finish().
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+
+inline int failures = 0;
+
+inline void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "ok    " : "FAIL  ") << what << std::endl;
+    if (!ok) ++failures;
+}
+
+// runs one case, failing it instead of hanging the whole run
+inline void runCase(const std::string& name, std::function<bool()> body) {
+    std::packaged_task<bool()> task(std::move(body));
+    std::future<bool> result = task.get_future();
+    std::thread(std::move(task)).detach();
+    if (result.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+        check(false, name + " (hung)");
+        std::cout << failures << " failure(s)\n";
+        std::_Exit(1);
+    }
+    check(result.get(), name);
+}
+
+inline int finish() {
+    std::cout << failures << " failure(s)\n";
+    return failures == 0 ? 0 : 1;
+}
+
+// keeps one worker busy until release() is called
+class BusyWorker {
+private:
+    std::promise<void> gate;
+public:
+    explicit BusyWorker(ThreadPool& pool) {
+        std::atomic<bool> started{false};
+        pool.post([&started, released = gate.get_future().share()] {
+            started = true;
+            released.wait();
+        });
+        while (!started) std::this_thread::yield();
+    }
+    void release() { gate.set_value(); }
+};
+
+// polls done() for up to timeout
+template<typename Pred>
+bool eventually(Pred done, std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
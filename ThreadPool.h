@@ -1,68 +1,1213 @@
+#pragma once
 #include <vector>
 #include <thread>
 #include <queue>
+#include <deque>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
 #include <future>
-class ThreadPool {
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <iterator>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "CancellationToken.h"
+#include "CpuTopology.h"
+#include "Task.h"
+#include "TaskQueue.h"
+#include "EventCount.h"
+#include "TimerWheel.h"
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+// Work-stealing deque owned by a single worker: a std::deque behind a per-worker
+// mutex (not a lock-free Chase-Lev deque). The owner pushes and pops at the
+// bottom (LIFO, so it keeps working on cache-hot tasks) while other workers
+// steal from the top (FIFO, so they take the oldest and usually largest work).
+// Every worker has its own lock, so the only contention is owner vs. thief, and
+// a thief only try_locks it, moving on to another victim when the owner holds it.
+template<typename T>
+class WorkStealingDeque {
 private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+    std::deque<T> items;
     std::mutex mtx;
-    std::condition_variable cv;
-    bool stop;
+    std::atomic<size_t> count{0};
+public:
+    void push(T item)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        items.push_back(std::move(item));
+        count.store(items.size(), std::memory_order_relaxed);
+    }
+    template<typename It>
+    void pushBulk(It first, It last)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for(; first != last; ++first) items.push_back(std::move(*first));
+        count.store(items.size(), std::memory_order_relaxed);
+    }
+    bool pop(T& out)
+    {
+        if(empty()) return false;
+        std::lock_guard<std::mutex> lock(mtx);
+        if(items.empty()) return false;
+        out = std::move(items.back());
+        items.pop_back();
+        count.store(items.size(), std::memory_order_relaxed);
+        return true;
+    }
+    bool steal(T& out)
+    {
+        if(empty()) return false;
+        // a busy victim is skipped rather than waited for, there are other victims
+        std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+        if(!lock.owns_lock() || items.empty()) return false;
+        out = std::move(items.front());
+        items.pop_front();
+        count.store(items.size(), std::memory_order_relaxed);
+        return true;
+    }
+    bool empty() const { return count.load(std::memory_order_relaxed) == 0; }
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+};
+
+enum class TaskPriority { High, Normal, Low };
+constexpr size_t PriorityLevels = 3;
+
+// how tasks submitted with a deadline are ordered
+enum class SchedulingPolicy {
+    Fifo,                  // deadlines are only checked for expiry, order is unchanged
+    EarliestDeadlineFirst  // deadline tasks run ahead of the FIFO queues, earliest first
+};
+// what a worker does with a deadline task it dequeues after the deadline passed
+enum class ExpiredTaskPolicy {
+    Run,  // run it anyway; it is still counted in expiredTaskCount()
+    Drop  // skip it, its future throws TaskExpired
+};
+
+// thrown from the future of a deadline task that was dropped
+class TaskExpired : public std::runtime_error {
+public:
+    TaskExpired() : std::runtime_error("ThreadPool task dropped after its deadline") {}
+};
+
+// what a submit does when the queue it targets is full (queueCapacity > 0)
+enum class RejectionPolicy {
+    Block,          // wait for space, at most ThreadPoolOptions::submitTimeout, then throw QueueFull
+    CallerRuns,     // run the task on the submitting thread instead
+    DiscardOldest,  // drop the oldest queued task of that priority to make room; its future
+                    // reports std::future_errc::broken_promise. postUnbounded() work is never dropped.
+    Throw           // throw QueueFull right away
+};
+
+// thrown by a submit that found its queue full
+class QueueFull : public std::runtime_error {
+public:
+    QueueFull() : std::runtime_error("ThreadPool queue is full") {}
+};
+
+// f(args...) as a callable without parameters; f and the arguments are stored by
+// value and passed to f as lvalues. Without arguments this is just a copy of f.
+template<typename F, typename... Args>
+auto bindTask(F&& f, Args&&... args)
+{
+    if constexpr (sizeof...(Args) == 0) {
+        return std::decay_t<F>(std::forward<F>(f));
+    } else {
+        return [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> decltype(auto) {
+            return std::apply(f, args);
+        };
+    }
+}
+
+// packaged_task running f(args...); result receives its future
+template<typename F, typename... Args>
+auto makePackagedTask(std::future<std::invoke_result_t<F, Args...>>& result, F&& f, Args&&... args)
+{
+    // the callable and its bound arguments live inside the packaged_task, which
+    // is itself stored inline in the Task: the future's shared state is the only allocation
+    std::packaged_task<std::invoke_result_t<F, Args...>()> task(bindTask(std::forward<F>(f), std::forward<Args>(args)...));
+    result = task.get_future();
+    return task;
+}
+
+struct ThreadPoolOptions {
+    size_t numThreads = std::thread::hardware_concurrency();
+    // most Normal tasks a worker moves out of the shared queue per lock acquisition; 1 disables batching
+    size_t maxDequeueBatch = 16;
+    // 0 keeps the shared queue unbounded (mutex + std::queue); anything else selects a
+    // preallocated lock-free ring of that many slots (rounded up to a power of two)
+    // and turns on backpressure: see rejectionPolicy. The bound applies to each queue
+    // separately: the three priority lanes, the deadline queue, and each worker's own
+    // deque, which takes the Normal submits of the tasks running on that worker (a
+    // worker may also move up to maxDequeueBatch tasks there from the Normal lane).
+    // postUnbounded() work and fired timers are never bounded.
+    size_t queueCapacity = 0;
+    // only matters with queueCapacity > 0. Workers never block on a full queue, they
+    // run the task themselves under Block, since only workers can make room. A full
+    // worker deque or deadline queue cannot drop its oldest task (the deque also holds
+    // postUnbounded() work), so DiscardOldest runs the task on the caller there instead.
+    RejectionPolicy rejectionPolicy = RejectionPolicy::Block;
+    // how long a RejectionPolicy::Block submit waits for space; max() waits for good
+    std::chrono::steady_clock::duration submitTimeout = std::chrono::steady_clock::duration::max();
+    // opt-in caller-runs under saturation: when no worker is parked and the queue a submit
+    // would go to already holds at least this many tasks, the submitting thread runs the
+    // task itself (its future is ready on return). 0 turns it off.
+    size_t inlineThreshold = 0;
+    // an idle worker spins with a pause instruction this many times, then yields this
+    // many times, before it parks; spinning trades CPU for submit-to-start latency
+    size_t spinIterations = 1000;
+    size_t yieldIterations = 8;
+    // a non-empty lower-priority queue is served at least once every agingThreshold
+    // dequeues, however much higher-priority work keeps arriving
+    size_t agingThreshold = 64;
+    SchedulingPolicy schedulingPolicy = SchedulingPolicy::Fifo;
+    ExpiredTaskPolicy expiredTaskPolicy = ExpiredTaskPolicy::Run;
+    // Elastic sizing, on when maxThreads > numThreads. The pool starts numThreads workers
+    // and adds one per controlInterval, up to maxThreads, while queued work waits longer
+    // than targetLatency and no worker is idle; a hill-climbing step backs off again when
+    // the extra worker did not raise throughput. Workers idle for idleTimeout retire,
+    // down to minThreads (at least 1). 0 keeps the pool fixed at numThreads.
+    size_t maxThreads = 0;
+    size_t minThreads = 1;
+    std::chrono::steady_clock::duration targetLatency = std::chrono::milliseconds(10);
+    std::chrono::steady_clock::duration idleTimeout = std::chrono::seconds(30);
+    std::chrono::steady_clock::duration controlInterval = std::chrono::milliseconds(100);
+    // CPU ids worker i is pinned to: workerAffinity[i % workerAffinity.size()]. Empty leaves
+    // workers to the scheduler; CpuTopology::perCpuAffinity() gives one core per worker.
+    std::vector<std::vector<int>> workerAffinity{};
+    // with workerAffinity set, idle workers steal from the nearest workers first (SMT
+    // sibling, shared L3, same NUMA node) and try workers on other nodes at most once per
+    // remoteStealInterval; a worker whose only work is remote parks in between
+    std::chrono::steady_clock::duration remoteStealInterval = std::chrono::microseconds(100);
+};
+
+class ThreadPool {
+private:
+    // per worker slot; a slot's deque and thread are reused when a retired worker is replaced
+    struct alignas(64) WorkerSlot {
+        std::atomic<bool> active{false};
+        std::atomic<uint64_t> completed{0}; // tasks run; only the slot's worker writes it
+        // only the slot's worker touches these
+        std::chrono::steady_clock::time_point nextRemoteSteal{};
+        bool remoteDeferred = false; // the last steal() skipped other nodes' workers
+    };
+    std::vector<std::thread> workers; // one per slot, not joinable while the slot is unused
+    std::vector<std::unique_ptr<WorkStealingDeque<Task>>> localTasks;
+    std::vector<std::vector<Task>> dequeueBuffers;
+    // shared queues, one per TaskPriority; Normal also takes submits from outside the pool
+    std::array<std::unique_ptr<TaskQueue>, PriorityLevels> tasks;
+    std::array<std::atomic<size_t>, PriorityLevels> laneAge{}; // dequeues since the lane was last served
+    DeadlineTaskQueue deadlineTasks; // only used with SchedulingPolicy::EarliestDeadlineFirst
+    const size_t queueCapacity;      // bound on the deadline queue and each worker's deque; 0 for none
+    // postUnbounded() from outside the pool and requeue(); no capacity, never discarded.
+    // Served after the Normal lane and aged like a lower-priority lane.
+    LockedTaskQueue unboundedTasks;
+    std::atomic<size_t> unboundedAge{0};
+    std::atomic<size_t> expiredTasks{0};
+    std::atomic<size_t> cancelledTasks{0};
+    std::atomic<size_t> rejectedTasks{0};
+    std::atomic<size_t> inlinedTasks{0};
+    EventCount idleEvent; // parked workers wait here
+    EventCount spaceEvent; // submits blocked on a full bounded queue wait here
+    EventCount helperEvent; // helpUntil() callers with nothing to run park here
+    std::atomic<size_t> pendingTasks{0};
+    std::atomic<bool> stop;
+    const size_t maxDequeueBatch;
+    const size_t spinIterations;
+    const size_t yieldIterations;
+    const size_t agingThreshold;
+    const SchedulingPolicy schedulingPolicy;
+    const ExpiredTaskPolicy expiredTaskPolicy;
+    const RejectionPolicy rejectionPolicy;
+    const std::chrono::steady_clock::duration submitTimeout;
+    const size_t inlineThreshold;
+    const bool elastic;
+    const size_t minWorkers;
+    const std::chrono::steady_clock::duration targetLatency;
+    const std::chrono::steady_clock::duration idleTimeout;
+    const std::chrono::steady_clock::duration controlInterval;
+    const std::vector<std::vector<int>> workerAffinity;
+    const std::chrono::steady_clock::duration remoteStealInterval;
+    // per worker, every other worker nearest first; victims from remoteVictims[i] on
+    // sit on another NUMA node
+    std::vector<std::vector<size_t>> victimOrder;
+    std::vector<size_t> remoteVictims;
+    std::unique_ptr<WorkerSlot[]> slots;
+    std::atomic<size_t> activeWorkers{0};
+    std::atomic<size_t> desiredWorkers{0}; // workers above this retire after their current task
+    std::mutex resizeMtx;                  // serializes spawning and retiring
+    // queue latency probe: a no-op task timed from enqueue to start, one in flight at a time
+    std::atomic<bool> probeInFlight{false};
+    std::atomic<int64_t> probeStart{0};    // steady_clock ticks
+    std::atomic<int64_t> probeLatency{0};  // steady_clock ticks of the last finished probe
+    std::thread controller;                // only runs for elastic pools
+    std::mutex controlMtx;
+    std::condition_variable controlCv;
+    std::function<void(std::exception_ptr)> exceptionHandler;
+    std::mutex handlerMtx;
+    // delayed and periodic tasks wait here, not on a worker; its thread starts on first use
+    TimerWheel timers{[this](Task task) { dispatchTimer(std::move(task)); }};
+
+    inline static thread_local ThreadPool* currentPool = nullptr;
+    inline static thread_local size_t currentIndex = 0;
 public:
-    ThreadPool(size_t numThreads):  stop(false) {
-        for(size_t i = 0; i < numThreads; ++i) {
-            workers.emplace_back(&ThreadPool::workerLoop, this);
+    ThreadPool(size_t numThreads): ThreadPool(ThreadPoolOptions{numThreads}) {}
+    explicit ThreadPool(const ThreadPoolOptions& options):  deadlineTasks(options.queueCapacity),
+        queueCapacity(options.queueCapacity), stop(false), maxDequeueBatch(std::max<size_t>(options.maxDequeueBatch, 1)),
+        spinIterations(options.spinIterations), yieldIterations(options.yieldIterations),
+        agingThreshold(std::max<size_t>(options.agingThreshold, 1)),
+        schedulingPolicy(options.schedulingPolicy), expiredTaskPolicy(options.expiredTaskPolicy),
+        rejectionPolicy(options.rejectionPolicy), submitTimeout(options.submitTimeout),
+        inlineThreshold(options.inlineThreshold), elastic(options.maxThreads > options.numThreads),
+        minWorkers(elastic ? std::clamp<size_t>(options.minThreads, 1, options.maxThreads) : options.numThreads),
+        targetLatency(options.targetLatency), idleTimeout(options.idleTimeout), controlInterval(options.controlInterval),
+        workerAffinity(options.workerAffinity), remoteStealInterval(options.remoteStealInterval) {
+        for(auto& lane : tasks) {
+            if(options.queueCapacity > 0) {
+                lane = std::make_unique<BoundedTaskQueue>(options.queueCapacity);
+            } else {
+                lane = std::make_unique<LockedTaskQueue>();
+            }
+        }
+        size_t maxWorkers = elastic ? options.maxThreads : options.numThreads;
+        for(size_t i = 0; i < maxWorkers; ++i) {
+            localTasks.emplace_back(std::make_unique<WorkStealingDeque<Task>>());
+            dequeueBuffers.emplace_back().reserve(maxDequeueBatch);
         }
+        slots = std::make_unique<WorkerSlot[]>(maxWorkers);
+        buildVictimOrder();
+        workers.resize(maxWorkers);
+        size_t initial = elastic ? std::max(options.numThreads, minWorkers) : options.numThreads;
+        std::lock_guard<std::mutex> lock(resizeMtx);
+        for(size_t i = 0; i < initial; ++i) spawnWorker();
+        desiredWorkers.store(initial);
+        if(elastic) controller = std::thread(&ThreadPool::controlLoop, this);
     }
     template<typename F, typename... Args>
     auto submit(F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        std::future<std::invoke_result_t<F, Args...>> res;
+        enqueue(Task(makePackagedTask(res, std::forward<F>(f), std::forward<Args>(args)...)));
+        return res;
+    }
+    template<typename F, typename... Args>
+    auto submit(TaskPriority priority, F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        std::future<std::invoke_result_t<F, Args...>> res;
+        enqueue(Task(makePackagedTask(res, std::forward<F>(f), std::forward<Args>(args)...)), priority);
+        return res;
+    }
+    // the token is checked right before the task runs: once it is cancelled the task
+    // is skipped and its future throws TaskCancelled. Long-running tasks can poll the
+    // same token (captured by the callable) to stop early.
+    template<typename F, typename... Args>
+    auto submit(CancellationToken token, F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>>
     {
         using return_type = std::invoke_result_t<F, Args...>;
-        auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-        std::future<return_type> res = task->get_future();
-        {
-            //critical section
-            std::unique_lock<std::mutex> lock(mtx);
-            if(stop) throw std::runtime_error("Submit on stopped ThreadPool");
-            tasks.emplace([task]() { (*task)(); });
+        std::future<return_type> res;
+        enqueue(Task(makePackagedTask(res,
+            [this, token, call = bindTask(std::forward<F>(f), std::forward<Args>(args)...)]() mutable -> return_type {
+                if(token.isCancelled()) {
+                    cancelledTasks.fetch_add(1, std::memory_order_relaxed);
+                    throw TaskCancelled();
+                }
+                return call();
+            })));
+        return res;
+    }
+    // the deadline is checked right before the task runs: a late task is counted and,
+    // with ExpiredTaskPolicy::Drop, skipped so that its future throws TaskExpired
+    template<typename F, typename... Args>
+    auto submitWithDeadline(std::chrono::steady_clock::time_point deadline, F&& f, Args&&... args)
+        -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        using return_type = std::invoke_result_t<F, Args...>;
+        std::future<return_type> res;
+        auto task = makePackagedTask(res,
+            [this, deadline, call = bindTask(std::forward<F>(f), std::forward<Args>(args)...)]() mutable -> return_type {
+                if(std::chrono::steady_clock::now() > deadline) {
+                    expiredTasks.fetch_add(1, std::memory_order_relaxed);
+                    if(expiredTaskPolicy == ExpiredTaskPolicy::Drop) throw TaskExpired();
+                }
+                return call();
+            });
+        if(schedulingPolicy == SchedulingPolicy::EarliestDeadlineFirst) {
+            enqueueDeadline(Task(std::move(task)), deadline);
+        } else {
+            enqueue(Task(std::move(task)));
         }
-        cv.notify_one(); // one worker wake up
         return res;
     }
+    template<typename Rep, typename Period, typename F, typename... Args>
+    auto submitWithTimeout(std::chrono::duration<Rep, Period> timeout, F&& f, Args&&... args)
+        -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        return submitWithDeadline(std::chrono::steady_clock::now() + timeout, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+    // fire-and-forget: no future, no shared state. Anything the callable throws
+    // is passed to the exception handler instead.
+    template<typename F, typename... Args>
+    void post(F&& f, Args&&... args)
+    {
+        enqueue(Task(bindTask(std::forward<F>(f), std::forward<Args>(args)...)));
+    }
+    template<typename F, typename... Args>
+    void post(TaskPriority priority, F&& f, Args&&... args)
+    {
+        enqueue(Task(bindTask(std::forward<F>(f), std::forward<Args>(args)...)), priority);
+    }
+    // skipped without running (and without reaching the exception handler) if the
+    // token is cancelled by the time a worker dequeues it
+    template<typename F, typename... Args>
+    void post(CancellationToken token, F&& f, Args&&... args)
+    {
+        enqueue(Task([this, token, call = bindTask(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+            if(token.isCancelled()) {
+                cancelledTasks.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            call();
+        }));
+    }
+    // Like post(), but never blocks, rejected or discarded: from outside the pool the
+    // task goes to an unbounded queue of its own instead of the shared queue that
+    // queueCapacity bounds. For work that finishes something already under way (a
+    // TaskGroup child, half of a parallelFor, a continuation, a strand's drain),
+    // where a dropped task would leave whoever waits for it hanging.
+    template<typename F>
+    void postUnbounded(F&& f)
+    {
+        enqueueUnbounded(Task(std::forward<F>(f)));
+    }
+    // postUnbounded() for a task that has had its turn and continues (a strand's next
+    // batch): it always goes to the shared unbounded queue, even from a worker, so it
+    // queues behind the caller's own deque and the Normal lane instead of being popped
+    // straight back by the worker that posted it
+    template<typename F>
+    void requeue(F&& f)
+    {
+        enqueueUnbounded(Task(std::forward<F>(f)), true);
+    }
+    // never blocks and ignores the rejection policy: returns no future, without
+    // running f, when the shared queue (on a worker, its own deque) is full
+    template<typename F, typename... Args>
+    auto trySubmit(F&& f, Args&&... args) -> std::optional<std::future<std::invoke_result_t<F, Args...>>>
+    {
+        std::future<std::invoke_result_t<F, Args...>> res;
+        Task wrapped(makePackagedTask(res, std::forward<F>(f), std::forward<Args>(args)...));
+        if(!tryEnqueue(wrapped)) return std::nullopt;
+        return res;
+    }
+    // false, without running f, when the shared queue (on a worker, its own deque) is full
+    template<typename F>
+    bool tryPost(F&& f)
+    {
+        Task task(std::forward<F>(f));
+        return tryEnqueue(task);
+    }
+    // submits every callable in [first, last) with one critical section and
+    // wakes at most one worker per task instead of locking and notifying per task
+    template<typename It>
+    auto submitBulk(It first, It last)
+        -> std::vector<std::future<std::invoke_result_t<typename std::iterator_traits<It>::value_type&>>>
+    {
+        using return_type = std::invoke_result_t<typename std::iterator_traits<It>::value_type&>;
+        std::vector<std::future<return_type>> results;
+        std::vector<Task> batch;
+        for(; first != last; ++first) {
+            std::packaged_task<return_type()> task(*first);
+            results.push_back(task.get_future());
+            batch.emplace_back(std::move(task));
+        }
+        enqueueBulk(batch);
+        return results;
+    }
+    template<typename It>
+    void postBulk(It first, It last)
+    {
+        std::vector<Task> batch;
+        for(; first != last; ++first) {
+            batch.emplace_back(*first);
+        }
+        enqueueBulk(batch);
+    }
+    // delayed and periodic tasks are held by the timer wheel and only posted to the
+    // queues once due, so waiting never occupies a worker. Exceptions go to the
+    // exception handler like any posted task.
+    template<typename Rep, typename Period, typename F>
+    TimerId scheduleAfter(std::chrono::duration<Rep, Period> delay, F&& f)
+    {
+        return scheduleAt(std::chrono::steady_clock::now() + delay, std::forward<F>(f));
+    }
+    template<typename F>
+    TimerId scheduleAt(std::chrono::steady_clock::time_point when, F&& f)
+    {
+        if(stop) throw std::runtime_error("Schedule on stopped ThreadPool");
+        return timers.scheduleAt(when, Task(std::forward<F>(f)));
+    }
+    template<typename Rep, typename Period, typename F>
+    TimerId scheduleEvery(std::chrono::duration<Rep, Period> period, F&& f)
+    {
+        if(stop) throw std::runtime_error("Schedule on stopped ThreadPool");
+        return timers.scheduleEvery(std::chrono::duration_cast<TimerWheel::Clock::duration>(period), Task(std::forward<F>(f)));
+    }
+    // true if the timer had not fired yet (or, for a periodic timer, was still active)
+    bool cancelTimer(TimerId id) { return timers.cancel(id); }
+#if defined(__cpp_impl_coroutine)
+    // co_await pool.schedule() resumes the coroutine on one of the workers
+    struct ScheduleAwaiter {
+        ThreadPool& pool;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { pool.postUnbounded([handle] { handle.resume(); }); }
+        void await_resume() const noexcept {}
+    };
+    ScheduleAwaiter schedule() { return ScheduleAwaiter{*this}; }
+    // The timer task of a sleeping coroutine. Fired, it resumes the coroutine. Destroyed
+    // unrun (shutdown() discards pending timers) it still resumes it, on a worker if the
+    // pool takes work yet, and the coroutine's co_await throws TaskCancelled.
+    class SleepTimer {
+    private:
+        ThreadPool* pool;
+        std::coroutine_handle<> handle;
+        bool* cancelled;
+    public:
+        SleepTimer(ThreadPool* pool, std::coroutine_handle<> handle, bool* cancelled)
+            : pool(pool), handle(handle), cancelled(cancelled) {}
+        SleepTimer(SleepTimer&& other) noexcept
+            : pool(std::exchange(other.pool, nullptr)), handle(other.handle), cancelled(other.cancelled) {}
+        SleepTimer& operator=(SleepTimer&&) = delete;
+        ~SleepTimer()
+        {
+            if(!pool) return;
+            *cancelled = true;
+            std::coroutine_handle<> h = handle;
+            try {
+                pool->postUnbounded([h] { h.resume(); });
+            } catch(const std::runtime_error&) {
+                h.resume(); // the pool is stopped: nowhere else to run it
+            }
+        }
+        void operator()()
+        {
+            pool = nullptr;
+            handle.resume();
+        }
+    };
+    // co_await pool.sleepUntil(...) / sleepFor(...) parks the coroutine on the timer
+    // wheel and resumes it on a worker, no thread is blocked in between. A sleep cut
+    // short by shutdown() throws TaskCancelled from the co_await.
+    struct SleepAwaiter {
+        ThreadPool& pool;
+        std::chrono::steady_clock::time_point when;
+        bool cancelled = false;
+        bool await_ready() const noexcept { return when <= std::chrono::steady_clock::now(); }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            try {
+                pool.scheduleAt(when, SleepTimer(&pool, handle, &cancelled));
+            } catch(const std::runtime_error&) {
+                // the pool is shutting down; the dropped SleepTimer has resumed us already
+            }
+        }
+        void await_resume() const
+        {
+            if(cancelled) throw TaskCancelled();
+        }
+    };
+    SleepAwaiter sleepUntil(std::chrono::steady_clock::time_point when) { return SleepAwaiter{*this, when}; }
+    template<typename Rep, typename Period>
+    SleepAwaiter sleepFor(std::chrono::duration<Rep, Period> delay)
+    {
+        return SleepAwaiter{*this, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay)};
+    }
+#endif
+    // handler for exceptions escaping posted tasks; without one they are dropped
+    void setExceptionHandler(std::function<void(std::exception_ptr)> handler)
+    {
+        std::lock_guard<std::mutex> lock(handlerMtx);
+        exceptionHandler = std::move(handler);
+    }
+    // passes error to the exception handler on the calling thread, as if a posted task
+    // had thrown it; for executors on top of the pool that catch their tasks' exceptions
+    void reportException(std::exception_ptr error)
+    {
+        std::function<void(std::exception_ptr)> handler;
+        {
+            std::lock_guard<std::mutex> lock(handlerMtx);
+            handler = exceptionHandler;
+        }
+        if(handler) handler(std::move(error));
+    }
     void shutdown()
     {
+        timers.shutdown(); // timers that have not fired yet are dropped
         {
-            std::unique_lock<std::mutex> lock(mtx);
+            std::lock_guard<std::mutex> lock(controlMtx);
             stop = true;
         }
-        cv.notify_all();
+        controlCv.notify_one();
+        if(controller.joinable()) controller.join(); // no worker is spawned after this
+        idleEvent.notifyAll();
         for(std::thread &worker : workers) {
             if(worker.joinable())
                 worker.join();
         }
     }
+    // workers currently running; varies over time for an elastic pool
+    size_t size() const { return activeWorkers.load(std::memory_order_relaxed); }
+    // upper bound on size() and on the indices workerIndex() returns
+    size_t maxSize() const { return localTasks.size(); }
+    // tasks waiting in the shared queue of the given priority; Normal does not include
+    // work already sitting in the workers' own deques
+    size_t queueDepth(TaskPriority priority) const { return tasks[static_cast<size_t>(priority)]->size(); }
+    size_t deadlineQueueDepth() const { return deadlineTasks.size(); }
+    // deadline tasks that were dequeued after their deadline, dropped or not
+    size_t expiredTaskCount() const { return expiredTasks.load(std::memory_order_relaxed); }
+    // tasks skipped because their cancellation token was cancelled before they ran
+    size_t cancelledTaskCount() const { return cancelledTasks.load(std::memory_order_relaxed); }
+    // submits that met a full queue and were run by the caller, discarded, timed out or
+    // thrown back, plus queued tasks dropped by RejectionPolicy::DiscardOldest
+    size_t rejectedTaskCount() const { return rejectedTasks.load(std::memory_order_relaxed); }
+    // submits run on the calling thread because the pool was saturated (inlineThreshold)
+    size_t inlinedTaskCount() const { return inlinedTasks.load(std::memory_order_relaxed); }
+    // true when called from one of this pool's worker threads
+    bool isWorkerThread() const { return currentPool == this; }
+    // index of the calling worker in [0, maxSize()), or maxSize() on any other thread
+    size_t workerIndex() const { return currentPool == this ? currentIndex : localTasks.size(); }
+    // tasks visible to thieves near the caller: its own deque on a worker, the shared
+    // Normal and unbounded queues elsewhere. Zero means idle workers would find nothing
+    // to steal here.
+    size_t localQueueDepth() const
+    {
+        if(currentPool == this) return localTasks[currentIndex]->size();
+        return tasks[static_cast<size_t>(TaskPriority::Normal)]->size() + unboundedTasks.size();
+    }
+    // runs one queued task on the calling thread, false if there was none. Workers
+    // look in their own deque first; other threads help with shared and stolen work.
+    bool runPendingTask()
+    {
+        Task task;
+        bool found = currentPool == this ? findTask(currentIndex, task) : findExternalTask(task);
+        if(!found) return false;
+        runTask(task);
+        return true;
+    }
+    // keeps the calling thread busy with queued tasks until done() holds, instead of
+    // blocking it. A task waiting on another task this way cannot deadlock the pool.
+    // A caller that finds nothing left to help with spins and yields like an idle
+    // worker, then parks until a task finishes or new work arrives, so done() must be
+    // made true by a task run on this pool.
+    template<typename Pred>
+    void helpUntil(Pred done)
+    {
+        size_t idleRounds = 0;
+        while(!done()) {
+            if(runPendingTask()) {
+                idleRounds = 0;
+            } else if(++idleRounds < spinIterations) {
+                cpuRelax();
+            } else if(idleRounds < spinIterations + yieldIterations) {
+                std::this_thread::yield();
+            } else {
+                // a worker whose only work sits on other nodes sleeps until its next
+                // remote steal is due, as in workerLoop
+                bool remoteOnly = currentPool == this && slots[currentIndex].remoteDeferred;
+                EventCount::Key key = helperEvent.prepareWait();
+                if(done() || (!remoteOnly && pendingTasks.load() > 0)) {
+                    helperEvent.cancelWait();
+                } else if(remoteOnly) {
+                    helperEvent.waitUntil(key, slots[currentIndex].nextRemoteSteal);
+                } else {
+                    helperEvent.wait(key);
+                }
+            }
+        }
+    }
+    // future.get() that runs other queued tasks while the result is not ready; the
+    // future must belong to one of this pool's tasks
+    template<typename Future>
+    decltype(auto) wait(Future& future)
+    {
+        helpUntil([&] { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+        return future.get();
+    }
 private:
-    void workerLoop()
+    void enqueue(Task task, TaskPriority priority = TaskPriority::Normal)
     {
+        if(inlineThreshold > 0 && !stop.load(std::memory_order_relaxed) && saturated(priority)) {
+            // no worker could start it any sooner: skip the enqueue, dequeue and wakeup
+            inlinedTasks.fetch_add(1, std::memory_order_relaxed);
+            runTask(task);
+            return;
+        }
+        enqueue(std::move(task), priority, rejectionPolicy);
+    }
+    // every worker is busy (none parked) and the target queue is already inlineThreshold deep
+    bool saturated(TaskPriority priority) const
+    {
+        if(idleEvent.waiters() > 0) return false;
+        size_t depth = currentPool == this && priority == TaskPriority::Normal
+            ? localTasks[currentIndex]->size()
+            : tasks[static_cast<size_t>(priority)]->size();
+        return depth >= inlineThreshold;
+    }
+    void enqueue(Task task, TaskPriority priority, RejectionPolicy policy)
+    {
+        pendingTasks.fetch_add(1);
+        if(currentPool == this && priority == TaskPriority::Normal) {
+            // submitted from a running task: keep it local, idle workers will steal it
+            if(!pushLocal(task, policy)) return;
+        } else {
+            // pendingTasks is bumped before stop is read, so a worker never retires
+            // while a submit that got past this check is still in flight
+            if(stop) {
+                pendingTasks.fetch_sub(1);
+                throw std::runtime_error("Submit on stopped ThreadPool");
+            }
+            if(!pushShared(task, static_cast<size_t>(priority), policy)) return;
+        }
+        wakeWorkers(1);
+    }
+    // pushes to a shared queue, applying policy if it is full. The task has been counted
+    // in pendingTasks; false if it ended up not queued (and no longer counted).
+    bool pushShared(Task& task, size_t level, RejectionPolicy policy)
+    {
+        TaskQueue& queue = *tasks[level];
+        if(queue.tryPush(task)) return true;
+        if(policy == RejectionPolicy::Block && currentPool == this) {
+            policy = RejectionPolicy::CallerRuns; // only workers make room, one must not wait for it
+        }
+        switch(policy) {
+        case RejectionPolicy::Block:
+            if(waitForSpace([&] { return queue.tryPush(task); })) return true;
+            break;
+        case RejectionPolicy::CallerRuns:
+            rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+            pendingTasks.fetch_sub(1);
+            runTask(task);
+            return false;
+        case RejectionPolicy::DiscardOldest:
+            while(!queue.tryPush(task)) {
+                Task oldest;
+                if(queue.tryPop(oldest)) {
+                    rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+                    pendingTasks.fetch_sub(1);
+                }
+            }
+            return true;
+        case RejectionPolicy::Throw:
+            break;
+        }
+        rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+        pendingTasks.fetch_sub(1);
+        throw QueueFull();
+    }
+    // parks until a worker frees a slot and tryPush() succeeds, or submitTimeout passes
+    template<typename TryPush>
+    bool waitForSpace(TryPush tryPush)
+    {
+        bool timed = submitTimeout != std::chrono::steady_clock::duration::max();
+        std::chrono::steady_clock::time_point deadline;
+        if(timed) deadline = std::chrono::steady_clock::now() + submitTimeout;
+        while(true) {
+            EventCount::Key key = spaceEvent.prepareWait();
+            if(tryPush()) {
+                spaceEvent.cancelWait();
+                return true;
+            }
+            if(!timed) {
+                spaceEvent.wait(key);
+            } else if(!spaceEvent.waitUntil(key, deadline)) {
+                return tryPush();
+            }
+        }
+    }
+    // pushes onto the calling worker's own deque, applying policy if it already holds
+    // queueCapacity tasks; counted in pendingTasks as for pushShared()
+    bool pushLocal(Task& task, RejectionPolicy policy)
+    {
+        WorkStealingDeque<Task>& local = *localTasks[currentIndex];
+        if(queueCapacity == 0 || local.size() < queueCapacity) {
+            local.push(std::move(task));
+            return true;
+        }
+        reject(task, policy); // a worker never waits for its own deque to drain
+        return false;
+    }
+    // a worker's deque or the deadline queue is full and policy is not a Block that may
+    // wait: run the task here, or throw QueueFull. The task is no longer counted.
+    void reject(Task& task, RejectionPolicy policy)
+    {
+        rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+        pendingTasks.fetch_sub(1);
+        if(policy == RejectionPolicy::Throw) throw QueueFull();
+        runTask(task);
+    }
+    void enqueueUnbounded(Task task, bool shared = false)
+    {
+        pendingTasks.fetch_add(1);
+        if(currentPool == this && !shared) {
+            localTasks[currentIndex]->push(std::move(task));
+        } else {
+            if(currentPool != this && stop) {
+                pendingTasks.fetch_sub(1);
+                throw std::runtime_error("Submit on stopped ThreadPool");
+            }
+            unboundedTasks.tryPush(task);
+        }
+        wakeWorkers(1);
+    }
+    bool tryEnqueue(Task& task)
+    {
+        pendingTasks.fetch_add(1);
+        if(currentPool == this) {
+            WorkStealingDeque<Task>& local = *localTasks[currentIndex];
+            if(queueCapacity > 0 && local.size() >= queueCapacity) {
+                pendingTasks.fetch_sub(1);
+                return false;
+            }
+            local.push(std::move(task));
+        } else {
+            if(stop) {
+                pendingTasks.fetch_sub(1);
+                throw std::runtime_error("Submit on stopped ThreadPool");
+            }
+            if(!tasks[static_cast<size_t>(TaskPriority::Normal)]->tryPush(task)) {
+                pendingTasks.fetch_sub(1);
+                return false;
+            }
+        }
+        wakeWorkers(1);
+        return true;
+    }
+    void dispatchTimer(Task task)
+    {
+        try {
+            // the task was accepted when it was scheduled: it is neither run on the timer
+            // thread nor held up or dropped by a full queue (sleeping coroutines resume this way)
+            enqueueUnbounded(std::move(task));
+        } catch(const std::runtime_error&) {
+            // the pool is shutting down, the timer fired too late to run
+        }
+    }
+    void enqueueDeadline(Task task, std::chrono::steady_clock::time_point deadline)
+    {
+        pendingTasks.fetch_add(1);
+        if(currentPool != this && stop) {
+            pendingTasks.fetch_sub(1);
+            throw std::runtime_error("Submit on stopped ThreadPool");
+        }
+        if(!deadlineTasks.tryPush(task, deadline)) {
+            if(rejectionPolicy != RejectionPolicy::Block || currentPool == this) {
+                reject(task, rejectionPolicy);
+                return;
+            }
+            if(!waitForSpace([&] { return deadlineTasks.tryPush(task, deadline); })) {
+                rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+                pendingTasks.fetch_sub(1);
+                throw QueueFull();
+            }
+        }
+        wakeWorkers(1);
+    }
+    void enqueueBulk(std::vector<Task>& batch)
+    {
+        if(batch.empty()) return;
+        pendingTasks.fetch_add(batch.size());
+        if(currentPool == this) {
+            WorkStealingDeque<Task>& local = *localTasks[currentIndex];
+            size_t room = batch.size();
+            if(queueCapacity > 0) room = std::min(room, queueCapacity - std::min(queueCapacity, local.size()));
+            local.pushBulk(batch.begin(), batch.begin() + room);
+            wakeWorkers(room);
+            for(auto it = batch.begin() + room; it != batch.end(); ++it) {
+                try {
+                    if(pushLocal(*it, rejectionPolicy)) wakeWorkers(1);
+                } catch(...) {
+                    pendingTasks.fetch_sub(batch.end() - it - 1);
+                    throw;
+                }
+            }
+            return;
+        }
+        if(stop) {
+            pendingTasks.fetch_sub(batch.size());
+            throw std::runtime_error("Submit on stopped ThreadPool");
+        }
+        Task* first = batch.data();
+        Task* last = first + batch.size();
+        size_t level = static_cast<size_t>(TaskPriority::Normal);
+        size_t pushed = tasks[level]->tryPushBulk(first, last);
+        first += pushed;
+        wakeWorkers(pushed);
+        // the queue filled up: the rest go one by one under the rejection policy
+        for(; first != last; ++first) {
+            try {
+                if(pushShared(*first, level, rejectionPolicy)) wakeWorkers(1);
+            } catch(...) {
+                pendingTasks.fetch_sub(last - first - 1); // the tasks after this one are dropped
+                throw;
+            }
+        }
+    }
+    void wakeWorkers(size_t count)
+    {
+        // pendingTasks was bumped before this, and a parking worker registers with
+        // idleEvent before re-checking pendingTasks, so one of us sees the other.
+        // Spinning workers are not registered and need no wakeup at all.
+        idleEvent.notify(count);
+        helperEvent.notifyAll();
+    }
+    void runTask(Task& task)
+    {
+        try {
+            task();
+        } catch(...) {
+            // only posted tasks get here, submit's packaged_task stores the exception in its future
+            reportException(std::current_exception());
+        }
+        // whatever a parked helpUntil() waits for is set by some task; a single load
+        // while nobody is parked
+        helperEvent.notifyAll();
+    }
+    // index is the calling worker, or maxSize() for a thread outside the pool, which
+    // has no deque to hold the rest of a batch and always takes a single task
+    bool popInjected(size_t index, TaskPriority priority, Task& task, bool allowBatch = true)
+    {
+        size_t level = static_cast<size_t>(priority);
+        size_t queued = tasks[level]->size();
+        if(queued == 0) return false;
+        // take a fair share of the backlog, but never more than maxDequeueBatch. Only
+        // Normal work is batched: aged and Low work would jump ahead of our own deque, and
+        // High work parked there would wait behind the other workers' Normal and Low lanes.
+        size_t take = 1;
+        if(allowBatch && priority == TaskPriority::Normal && index < localTasks.size()) {
+            take = std::clamp<size_t>(queued / std::max<size_t>(size(), 1), 1, maxDequeueBatch);
+        }
+        if(take == 1) {
+            if(!tasks[level]->tryPop(task)) return false;
+            spaceEvent.notify(1);
+        } else {
+            std::vector<Task>& batch = dequeueBuffers[index];
+            size_t taken = tasks[level]->tryPopBulk(batch, take);
+            if(taken == 0) return false;
+            spaceEvent.notify(taken);
+            task = std::move(batch.front());
+            if(batch.size() > 1) {
+                // the rest of the batch goes onto our own deque where others can still
+                // steal it; reversed so our LIFO pops keep the submission order
+                localTasks[index]->pushBulk(batch.rbegin(), batch.rend() - 1);
+            }
+            batch.clear();
+        }
+        if(laneAge[level].load(std::memory_order_relaxed) != 0) {
+            laneAge[level].store(0, std::memory_order_relaxed);
+        }
+        return true;
+    }
+    bool steal(size_t index, Task& task)
+    {
+        const std::vector<size_t>& order = victimOrder[index];
+        const size_t remote = remoteVictims[index];
+        WorkerSlot& slot = slots[index];
+        slot.remoteDeferred = false;
+        for(size_t i = 0; i < remote; ++i) {
+            if(localTasks[order[i]]->steal(task)) return true;
+        }
+        if(remote == order.size()) return false;
+        // cross-socket steals are rate-limited in time, not in rounds
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(now < slot.nextRemoteSteal) {
+            slot.remoteDeferred = true;
+            return false;
+        }
+        slot.nextRemoteSteal = now + remoteStealInterval;
+        for(size_t i = remote; i < order.size(); ++i) {
+            if(localTasks[order[i]]->steal(task)) return true;
+        }
+        return false;
+    }
+    // 0 SMT siblings, 1 shared last-level cache, 2 same NUMA node (or unknown), 3 remote
+    static int distance(const CpuInfo* a, const CpuInfo* b)
+    {
+        if(!a || !b) return 2;
+        if(a->core == b->core) return 0;
+        if(a->l3 >= 0 && a->l3 == b->l3) return 1;
+        return a->node == b->node ? 2 : 3;
+    }
+    // Victims are ordered by topology distance between the workers' pinned CPUs (the
+    // first CPU of each affinity set), then by ring position, so workers at the same
+    // distance do not all raid the same victim first. Unpinned pools keep a plain ring.
+    void buildVictimOrder()
+    {
+        size_t n = localTasks.size();
+        std::vector<const CpuInfo*> home(n, nullptr);
+        std::optional<CpuTopology> topology;
+        if(!workerAffinity.empty()) {
+            topology.emplace();
+            for(size_t i = 0; i < n; ++i) {
+                const std::vector<int>& cpus = workerAffinity[i % workerAffinity.size()];
+                if(!cpus.empty()) home[i] = topology->cpu(cpus.front());
+            }
+        }
+        victimOrder.resize(n);
+        remoteVictims.resize(n);
+        for(size_t i = 0; i < n; ++i) {
+            std::vector<std::pair<int, size_t>> ranked;
+            for(size_t offset = 1; offset < n; ++offset) {
+                size_t victim = (i + offset) % n;
+                ranked.emplace_back(distance(home[i], home[victim]), victim);
+            }
+            std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            remoteVictims[i] = ranked.size();
+            for(size_t k = 0; k < ranked.size(); ++k) {
+                victimOrder[i].push_back(ranked[k].second);
+                if(ranked[k].first == 3 && remoteVictims[i] == ranked.size()) remoteVictims[i] = k;
+            }
+        }
+    }
+    // anti-starvation: every dequeue ages the waiting lower-priority lanes and the
+    // unbounded queue, and one that has been passed over agingThreshold times is
+    // served ahead of everything else
+    bool popAged(size_t index, Task& task)
+    {
+        for(size_t level = PriorityLevels - 1; level > 0; --level) {
+            if(tasks[level]->size() == 0) continue;
+            if(laneAge[level].fetch_add(1, std::memory_order_relaxed) + 1 >= agingThreshold
+                && popInjected(index, static_cast<TaskPriority>(level), task, false)) {
+                return true;
+            }
+        }
+        return unboundedTasks.size() > 0
+            && unboundedAge.fetch_add(1, std::memory_order_relaxed) + 1 >= agingThreshold
+            && popUnbounded(task);
+    }
+    bool popDeadline(Task& task)
+    {
+        if(!deadlineTasks.tryPop(task)) return false;
+        spaceEvent.notify(1);
+        return true;
+    }
+    bool popUnbounded(Task& task)
+    {
+        if(!unboundedTasks.tryPop(task)) return false;
+        if(unboundedAge.load(std::memory_order_relaxed) != 0) unboundedAge.store(0, std::memory_order_relaxed);
+        return true;
+    }
+    // same order as findTask, aging included, for a thread helping from outside the pool
+    bool findExternalTask(Task& task)
+    {
+        const size_t external = localTasks.size();
+        bool found = popAged(external, task)
+            || popDeadline(task)
+            || popInjected(external, TaskPriority::High, task)
+            || popInjected(external, TaskPriority::Normal, task)
+            || popUnbounded(task)
+            || popInjected(external, TaskPriority::Low, task);
+        for(size_t i = 0; !found && i < localTasks.size(); ++i) {
+            found = localTasks[i]->steal(task);
+        }
+        if(found) pendingTasks.fetch_sub(1);
+        return found;
+    }
+    bool findTask(size_t index, Task& task)
+    {
+        if(popAged(index, task)
+            || popDeadline(task)
+            || popInjected(index, TaskPriority::High, task)
+            || localTasks[index]->pop(task)
+            || popInjected(index, TaskPriority::Normal, task)
+            || popUnbounded(task)
+            || popInjected(index, TaskPriority::Low, task)
+            || steal(index, task)) {
+            pendingTasks.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+    void workerLoop(size_t index)
+    {
+        currentPool = this;
+        currentIndex = index;
+        if(!workerAffinity.empty()) pinCurrentThread(workerAffinity[index % workerAffinity.size()]);
         while(true)
         {
-            std::function<void()> task;
+            Task task;
+            if(findTask(index, task)) {
+                runTask(task); // execute the task outside any critical section
+                if(elastic) {
+                    WorkerSlot& slot = slots[index];
+                    slot.completed.store(slot.completed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    // the controller scaled down: the first worker to notice leaves
+                    if(size() > desiredWorkers.load(std::memory_order_relaxed)
+                        && tryRetire(index, std::max(minWorkers, desiredWorkers.load()))) {
+                        return;
+                    }
+                }
+                continue;
+            }
 
-            //critical section
-            {
-                std::unique_lock<std::mutex> lock(mtx);
-                cv.wait(lock, [this] {return stop || !tasks.empty();});
-                if(stop && tasks.empty()) return;
-                task = std::move(tasks.front());
-                tasks.pop();
+            //nothing local, injected or stealable: spin, then yield, then park
+            bool remoteOnly = slots[index].remoteDeferred;
+            if(!remoteOnly && waitForWork()) continue;
+            EventCount::Key key = idleEvent.prepareWait();
+            if(remoteOnly && pendingTasks.load() > 0) {
+                // what is pending may all sit on other nodes: sleep until the next remote
+                // steal is due, unless a submit wakes us first
+                idleEvent.waitUntil(key, slots[index].nextRemoteSteal);
+                continue;
             }
-            // end the critical section
-            task(); // execute the task outside the critical section
+            if(pendingTasks.load() > 0) {
+                idleEvent.cancelWait();
+                continue;
+            }
+            if(stop) {
+                idleEvent.cancelWait();
+                return;
+            }
+            if(!elastic) {
+                idleEvent.wait(key);
+            } else if(!idleEvent.waitUntil(key, std::chrono::steady_clock::now() + idleTimeout)
+                && pendingTasks.load() == 0 && tryRetire(index, minWorkers)) {
+                return; // idle for a whole idleTimeout
+            }
+        }
+    }
+    // starts a worker in a free slot; resizeMtx must be held
+    bool spawnWorker()
+    {
+        for(size_t i = 0; i < localTasks.size(); ++i) {
+            if(slots[i].active.load(std::memory_order_relaxed)) continue;
+            if(workers[i].joinable()) workers[i].join(); // retired, and already on its way out
+            slots[i].active.store(true, std::memory_order_relaxed);
+            activeWorkers.fetch_add(1);
+            workers[i] = std::thread(&ThreadPool::workerLoop, this, i);
+            return true;
+        }
+        return false;
+    }
+    // lets worker `index` exit if that leaves more than floor workers; its deque must be
+    // empty, since nobody else would pop from it
+    bool tryRetire(size_t index, size_t floor)
+    {
+        std::lock_guard<std::mutex> lock(resizeMtx);
+        size_t active = activeWorkers.load();
+        if(active <= floor || stop || !localTasks[index]->empty()) return false;
+        slots[index].active.store(false, std::memory_order_relaxed);
+        activeWorkers.fetch_sub(1);
+        desiredWorkers.store(std::min(desiredWorkers.load(), active - 1));
+        return true;
+    }
+    uint64_t completedTasks() const
+    {
+        uint64_t total = 0;
+        for(size_t i = 0; i < localTasks.size(); ++i) total += slots[i].completed.load(std::memory_order_relaxed);
+        return total;
+    }
+    // The probe task. It reports back however it ends: when a worker starts it, or when
+    // it is destroyed unrun because the queue was full or RejectionPolicy::DiscardOldest
+    // dropped it, which counts as an unbounded latency.
+    class LatencyProbe {
+    private:
+        ThreadPool* pool;
+    public:
+        explicit LatencyProbe(ThreadPool* pool) : pool(pool) {}
+        LatencyProbe(LatencyProbe&& other) noexcept : pool(std::exchange(other.pool, nullptr)) {}
+        LatencyProbe& operator=(LatencyProbe&&) = delete;
+        ~LatencyProbe()
+        {
+            if(pool) pool->finishProbe(std::numeric_limits<int64_t>::max());
+        }
+        void operator()()
+        {
+            ThreadPool* owner = std::exchange(pool, nullptr);
+            int64_t started = std::chrono::steady_clock::now().time_since_epoch().count();
+            owner->finishProbe(started - owner->probeStart.load(std::memory_order_relaxed));
+        }
+    };
+    void finishProbe(int64_t latency)
+    {
+        probeLatency.store(latency, std::memory_order_relaxed);
+        probeInFlight.store(false, std::memory_order_release);
+    }
+    // how long queued work currently waits before a worker starts it, measured by
+    // timing a no-op probe task from enqueue to start. While a probe is still queued
+    // its age is a lower bound; otherwise the last probe's latency is reported and a
+    // new probe goes out.
+    std::chrono::steady_clock::duration queueLatency()
+    {
+        using Clock = std::chrono::steady_clock;
+        int64_t now = Clock::now().time_since_epoch().count();
+        if(probeInFlight.load(std::memory_order_acquire)) {
+            return Clock::duration(now - probeStart.load(std::memory_order_relaxed));
+        }
+        Clock::duration last(probeLatency.load(std::memory_order_relaxed));
+        probeStart.store(now, std::memory_order_relaxed);
+        probeInFlight.store(true, std::memory_order_release);
+        Task probe(LatencyProbe(this));
+        if(!tryEnqueue(probe)) return Clock::duration::max(); // the queue is full; probe reports it
+        return last;
+    }
+    // Elastic pools only. Every controlInterval: if work is queued, nobody is parked
+    // and queue latency is above target, take one hill-climbing step on the worker
+    // count. Adding workers continues while throughput keeps up; a step that cost
+    // throughput (blocking tasks help, CPU-bound ones past the core count do not) is
+    // undone. Shrinking without backlog is left to the idle timeout.
+    void controlLoop()
+    {
+        uint64_t lastCompleted = completedTasks();
+        double lastThroughput = 0;
+        int lastMove = 0;
+        std::unique_lock<std::mutex> lock(controlMtx);
+        while(!controlCv.wait_for(lock, controlInterval, [this] { return stop.load(); })) {
+            uint64_t completed = completedTasks();
+            double throughput = static_cast<double>(completed - lastCompleted);
+            lastCompleted = completed;
+            bool backlogged = idleEvent.waiters() == 0 && pendingTasks.load() > 0 && queueLatency() > targetLatency;
+            if(!backlogged) {
+                lastMove = 0;
+                lastThroughput = throughput;
+                continue;
+            }
+            int move = lastMove == 0 ? 1 : lastMove;
+            if(lastMove != 0 && throughput < lastThroughput * 0.95) move = -lastMove;
+            lastThroughput = throughput;
+            std::lock_guard<std::mutex> resize(resizeMtx);
+            size_t active = activeWorkers.load();
+            if(move > 0 && spawnWorker()) {
+                desiredWorkers.store(active + 1);
+            } else if(move < 0 && active > minWorkers) {
+                desiredWorkers.store(active - 1);
+            } else {
+                move = 0;
+            }
+            lastMove = move;
+        }
+    }
+    // true as soon as work shows up during the spin/yield phase
+    bool waitForWork()
+    {
+        for(size_t i = 0; i < spinIterations; ++i) {
+            if(pendingTasks.load(std::memory_order_relaxed) > 0) return true;
+            if(stop.load(std::memory_order_relaxed)) return false;
+            cpuRelax();
+        }
+        for(size_t i = 0; i < yieldIterations; ++i) {
+            if(pendingTasks.load(std::memory_order_relaxed) > 0) return true;
+            if(stop.load(std::memory_order_relaxed)) return false;
+            std::this_thread::yield();
         }
+        return false;
     }
 
 };
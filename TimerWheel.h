@@ -0,0 +1,266 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Task.h"
+
+using TimerId = uint64_t; // 0 is never a valid id
+
+// Hierarchical hashed timing wheel driven by one thread. Four levels of 256
+// slots with a 1ms tick cover ~49 days; timers further out park in the last
+// level and are re-hashed as it turns. Each slot is an intrusive list, so
+// inserting and cancelling a timer are O(1) no matter how many are pending.
+// The wheel never runs a callback itself: due tasks are handed to `dispatch`.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimeSource = std::function<Clock::time_point()>;
+private:
+    static constexpr size_t Levels = 4;
+    static constexpr size_t SlotBits = 8;
+    static constexpr size_t Slots = size_t(1) << SlotBits;
+    static constexpr uint64_t SlotMask = Slots - 1;
+
+    struct Node {
+        TimerId id;
+        uint64_t expiry;  // absolute tick
+        uint64_t period;  // ticks, 0 for one-shot timers
+        Task task;                       // one-shot callback
+        std::shared_ptr<Task> periodic;  // periodic callback, shared with runs still in flight
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        Node** head = nullptr;           // slot list the node is linked into
+        size_t level = 0;                // wheel level of that slot
+    };
+
+    std::array<std::array<Node*, Slots>, Levels> wheel{};
+    std::array<size_t, Levels> linked{}; // nodes per level
+    std::unordered_map<TimerId, Node*> timers;
+    std::function<void(Task)> dispatch;
+    const TimeSource now;
+    const Clock::time_point start;
+    uint64_t currentTick = 0; // every tick up to and including this one has been processed
+    TimerId nextId = 1;
+    bool stop = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread thread;
+
+    uint64_t tickOf(Clock::time_point tp) const
+    {
+        if(tp <= start) return 0;
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(tp - start).count());
+    }
+    // first tick at or after tp, so a timer never fires early
+    uint64_t expiryTickOf(Clock::time_point tp) const
+    {
+        if(tp <= start) return 0;
+        return static_cast<uint64_t>(std::chrono::ceil<std::chrono::milliseconds>(tp - start).count());
+    }
+    void link(Node* node, size_t level, Node*& head)
+    {
+        node->prev = nullptr;
+        node->next = head;
+        if(head) head->prev = node;
+        head = node;
+        node->head = &head;
+        node->level = level;
+        ++linked[level];
+    }
+    void unlink(Node* node)
+    {
+        if(node->prev) node->prev->next = node->next;
+        else *node->head = node->next;
+        if(node->next) node->next->prev = node->prev;
+        node->prev = node->next = nullptr;
+        node->head = nullptr;
+        --linked[node->level];
+    }
+    // links node where it fires on its expiry tick, at the earliest on `first` (the next
+    // tick, or while cascading the current one, whose level-0 slot has not run yet)
+    void insert(Node* node, uint64_t first)
+    {
+        if(node->expiry < first) node->expiry = first;
+        uint64_t delta = node->expiry - currentTick;
+        for(size_t level = 0; level < Levels; ++level) {
+            size_t shift = level * SlotBits;
+            if(delta < (uint64_t(1) << (shift + SlotBits)) || level == Levels - 1) {
+                uint64_t expiry = node->expiry;
+                if(level == Levels - 1 && delta >= (uint64_t(1) << (shift + SlotBits))) {
+                    // beyond the wheel's range: park in the farthest slot, re-hashed when it comes round
+                    expiry = currentTick + (uint64_t(SlotMask) << shift);
+                }
+                link(node, level, wheel[level][(expiry >> shift) & SlotMask]);
+                return;
+            }
+        }
+    }
+    // moves every node of a higher-level slot down to where it belongs now
+    void cascade(size_t level)
+    {
+        Node* node = wheel[level][(currentTick >> (level * SlotBits)) & SlotMask];
+        wheel[level][(currentTick >> (level * SlotBits)) & SlotMask] = nullptr;
+        while(node) {
+            Node* next = node->next;
+            node->prev = node->next = nullptr;
+            --linked[level];
+            insert(node, currentTick); // due this very tick if it expires on the boundary
+            node = next;
+        }
+    }
+    // the next tick that can fire or cascade anything: the next turn of the lowest
+    // level holding timers, so sparse far-off timers are caught up in a few steps
+    uint64_t nextEventTick() const
+    {
+        for(size_t level = 0; level < Levels; ++level) {
+            if(linked[level] == 0) continue;
+            uint64_t span = uint64_t(1) << (level * SlotBits);
+            return (currentTick | (span - 1)) + 1;
+        }
+        return UINT64_MAX;
+    }
+    void advance(uint64_t tick, std::vector<Task>& due)
+    {
+        while(currentTick < tick) {
+            uint64_t next = nextEventTick();
+            if(next > tick) {
+                currentTick = tick;
+                break;
+            }
+            currentTick = next;
+            for(size_t level = 1; level < Levels; ++level) {
+                if((currentTick & ((uint64_t(1) << (level * SlotBits)) - 1)) != 0) break;
+                cascade(level);
+            }
+            Node*& head = wheel[0][currentTick & SlotMask];
+            Node* node = head;
+            head = nullptr;
+            while(node) {
+                Node* next = node->next;
+                node->prev = node->next = nullptr;
+                --linked[0];
+                if(node->expiry > currentTick) {
+                    insert(node, currentTick + 1); // a parked far-future timer, not due yet
+                } else if(node->period > 0) {
+                    std::shared_ptr<Task> fn = node->periodic;
+                    due.emplace_back([fn] { (*fn)(); });
+                    node->expiry += node->period;
+                    insert(node, currentTick + 1);
+                } else {
+                    due.push_back(std::move(node->task));
+                    timers.erase(node->id);
+                    delete node;
+                }
+                node = next;
+            }
+        }
+    }
+    // ticks until the next non-empty level-0 slot, or until level 0 wraps and must cascade
+    uint64_t ticksToNextEvent() const
+    {
+        uint64_t untilWrap = Slots - (currentTick & SlotMask);
+        for(uint64_t i = 1; i < untilWrap; ++i) {
+            if(wheel[0][(currentTick + i) & SlotMask]) return i;
+        }
+        return untilWrap;
+    }
+    void run()
+    {
+        std::vector<Task> due;
+        std::unique_lock<std::mutex> lock(mtx);
+        while(!stop) {
+            if(timers.empty()) {
+                cv.wait(lock); // add() catches currentTick up before inserting
+                continue;
+            }
+            advance(tickOf(now()), due);
+            if(!due.empty()) {
+                lock.unlock();
+                for(Task& task : due) dispatch(std::move(task));
+                due.clear();
+                lock.lock();
+                continue;
+            }
+            Clock::time_point wake = start + std::chrono::milliseconds(currentTick + ticksToNextEvent());
+            cv.wait_for(lock, wake - now()); // relative: now() need not be the real clock
+        }
+    }
+    TimerId add(Clock::time_point when, uint64_t period, Task task, std::shared_ptr<Task> periodic)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(stop) throw std::runtime_error("Schedule on stopped TimerWheel");
+        if(!thread.joinable()) {
+            thread = std::thread(&TimerWheel::run, this);
+        }
+        Node* node = new Node{nextId++, expiryTickOf(when), period, std::move(task), std::move(periodic)};
+        // catch the wheel up first, in case the thread has been idle without timers
+        if(timers.empty()) currentTick = std::max(currentTick, tickOf(now()));
+        timers.emplace(node->id, node);
+        insert(node, currentTick + 1);
+        cv.notify_one();
+        return node->id;
+    }
+public:
+    // now is the wheel's clock; tests pass one they can move forward by hand
+    explicit TimerWheel(std::function<void(Task)> dispatch, TimeSource now = &Clock::now)
+        : dispatch(std::move(dispatch)), now(std::move(now)), start(this->now()) {}
+    ~TimerWheel() { shutdown(); }
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    TimerId scheduleAt(Clock::time_point when, Task task)
+    {
+        return add(when, 0, std::move(task), nullptr);
+    }
+    // the first run is one period from now; runs may overlap if the callback outlasts the period
+    TimerId scheduleEvery(Clock::duration period, Task task)
+    {
+        uint64_t ticks = std::max<uint64_t>(1, std::chrono::duration_cast<std::chrono::milliseconds>(period).count());
+        return add(now() + period, ticks, Task(), std::make_shared<Task>(std::move(task)));
+    }
+    // true if the timer was still pending; a periodic timer stops firing
+    bool cancel(TimerId id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = timers.find(id);
+        if(it == timers.end()) return false;
+        Node* node = it->second;
+        if(node->head) unlink(node);
+        timers.erase(it);
+        delete node;
+        return true;
+    }
+    size_t pending()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return timers.size();
+    }
+    // stops the timer thread and discards the timers that have not fired: their tasks
+    // are destroyed unrun, here on the calling thread. Scheduling fails from now on.
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_one();
+        if(thread.joinable()) thread.join();
+        std::unordered_map<TimerId, Node*> discarded;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            discarded.swap(timers);
+            wheel = {};
+            linked = {};
+        }
+        for(auto& entry : discarded) delete entry.second; // outside the lock, a task's destructor may call back in
+    }
+};
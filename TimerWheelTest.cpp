@@ -0,0 +1,130 @@
+// Checks the timer wheel on a clock moved forward by hand: timers crossing the
+// level boundaries (256 ms, 65.5 s), far-future timers parked past the wheel's
+// range, and cancelling timers that sit in the higher levels.
+// Build: g++ -std=c++17 -O2 -pthread TimerWheelTest.cpp -o TimerWheelTest
+#include "TestSupport.h"
+#include "TimerWheel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using std::chrono::milliseconds;
+using Clock = TimerWheel::Clock;
+
+// the real clock plus an offset the test moves forward
+class ManualClock {
+private:
+    std::atomic<Clock::duration::rep> offset{0};
+public:
+    Clock::time_point now() const { return Clock::now() + Clock::duration(offset.load()); }
+    void advance(Clock::duration by) { offset += by.count(); }
+};
+
+// a wheel on a ManualClock that records which timers fired, in order
+class Harness {
+private:
+    std::mutex mtx;
+    std::vector<int> fired;
+public:
+    ManualClock clock;
+    Clock::time_point origin;
+    TimerWheel wheel;
+
+    Harness()
+        : origin(Clock::now()),
+          wheel([this](Task task) { task(); }, [this] { return clock.now(); }) {}
+    ~Harness() { wheel.shutdown(); }
+
+    TimerId at(Clock::duration after, int id) {
+        return wheel.scheduleAt(origin + after, Task([this, id] {
+            std::lock_guard<std::mutex> lock(mtx);
+            fired.push_back(id);
+        }));
+    }
+    std::vector<int> firedSoFar() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return fired;
+    }
+    size_t firedCount() { return firedSoFar().size(); }
+    // moves the clock to origin + to, then waits for count timers in all to have fired
+    bool reach(Clock::duration to, size_t count) {
+        clock.advance(origin + to - clock.now());
+        return eventually([&] { return firedCount() >= count; }) && firedCount() == count;
+    }
+    // moves the clock to origin + to and gives the wheel a few wakeups to fire anything
+    // early; the clock keeps running meanwhile, so keep `to` well short of the next timer
+    bool quiet(Clock::duration to, size_t count) {
+        clock.advance(origin + to - clock.now());
+        std::this_thread::sleep_for(milliseconds(300));
+        return firedCount() == count;
+    }
+};
+
+int main() {
+    runCase("timers around the 256 ms boundaries fire in order, none early", [] {
+        Harness h;
+        int ids[] = {1023, 1024, 1025, 1100, 1279, 1280, 1281};
+        for (int id : ids) h.at(milliseconds(id), id);
+        bool early = h.quiet(milliseconds(500), 0);
+        bool all = h.reach(milliseconds(1400), 7);
+        std::vector<int> fired = h.firedSoFar();
+        return early && all && std::equal(fired.begin(), fired.end(), std::begin(ids));
+    });
+    runCase("timers around the 65.5 s boundary fire in order, none early", [] {
+        Harness h;
+        int ids[] = {65535, 65536, 65537, 70000};
+        for (int id : ids) h.at(milliseconds(id), id);
+        bool first = h.quiet(milliseconds(65000), 0);
+        bool three = h.reach(milliseconds(66000), 3);
+        bool last = h.reach(milliseconds(70001), 4);
+        std::vector<int> fired = h.firedSoFar();
+        return first && three && last && std::equal(fired.begin(), fired.end(), std::begin(ids));
+    });
+    runCase("a timer past the wheel's range parks and fires on time", [] {
+        Harness h;
+        auto days = [](int n) { return std::chrono::hours(24 * n); };
+        h.at(days(60), 1);
+        h.at(days(60) + milliseconds(1), 2);
+        bool early = h.quiet(days(60) - milliseconds(1000), 0);
+        bool due = h.reach(days(60) + milliseconds(5), 2);
+        return early && due && h.firedSoFar() == std::vector<int>{1, 2};
+    });
+    runCase("timers cancelled in the higher levels never fire", [] {
+        Harness h;
+        TimerId level1 = h.at(milliseconds(1000), 1);
+        TimerId level2 = h.at(milliseconds(70000), 2);
+        TimerId parked = h.at(std::chrono::hours(24 * 60), 3);
+        h.at(milliseconds(70001), 4);
+        bool cancelled = h.wheel.cancel(level1) && h.wheel.cancel(level2) && h.wheel.cancel(parked);
+        bool again = h.wheel.cancel(level2);
+        bool rest = h.reach(std::chrono::hours(24 * 61), 1);
+        return cancelled && !again && rest && h.firedSoFar() == std::vector<int>{4} && h.wheel.pending() == 0;
+    });
+    runCase("a periodic timer keeps its period across a level boundary", [] {
+        Harness h;
+        std::atomic<int> runs{0};
+        TimerId id = h.wheel.scheduleEvery(milliseconds(100), Task([&runs] { ++runs; }));
+        h.clock.advance(milliseconds(1050));
+        bool ten = eventually([&] { return runs >= 10; });
+        h.wheel.cancel(id);
+        return ten && runs <= 11; // the clock kept running a little meanwhile
+    });
+    runCase("shutdown drops pending timers and refuses new ones", [] {
+        Harness h;
+        h.at(milliseconds(1000), 1);
+        h.wheel.shutdown();
+        bool refused = false;
+        try {
+            h.at(milliseconds(1), 2);
+        } catch (const std::runtime_error&) {
+            refused = true;
+        }
+        return refused && h.wheel.pending() == 0 && h.firedCount() == 0;
+    });
+
+    return finish();
+}
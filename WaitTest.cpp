@@ -0,0 +1,70 @@
+// Checks that a worker waiting inside a task (PoolFuture::get, TaskGroup::wait) on
+// work that is not ready yet parks instead of burning its CPU.
+// Build: g++ -std=c++17 -O2 -pthread WaitTest.cpp -o WaitTest
+#include "PoolFuture.h"
+#include "TaskGroup.h"
+#include "TestSupport.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <future>
+#include <thread>
+
+constexpr auto Delay = std::chrono::milliseconds(300);
+
+// process CPU time spent in waitInTask(), which runs on a worker and waits about
+// Delay for something it cannot help with
+template<typename Wait>
+double cpuSeconds(ThreadPool& pool, Wait waitInTask) {
+    std::clock_t before = std::clock();
+    std::future<void> done = pool.submit(waitInTask);
+    done.get();
+    return static_cast<double>(std::clock() - before) / CLOCKS_PER_SEC;
+}
+
+int main() {
+    runCase("PoolFuture::get on a worker parks", [] {
+        ThreadPool pool(2);
+        double cpu = cpuSeconds(pool, [&pool] {
+            auto state = std::make_shared<PoolFutureState<int>>(&pool);
+            pool.scheduleAfter(Delay, [state] { state->setValue(1); });
+            PoolFuture<int>(state).get();
+        });
+        pool.shutdown();
+        return cpu < 0.1;
+    });
+    runCase("TaskGroup::wait in a task parks", [] {
+        ThreadPool pool(2);
+        double cpu = cpuSeconds(pool, [&pool] {
+            std::atomic<bool> started{false};
+            TaskGroup group(pool);
+            group.run([&started] {
+                started = true;
+                std::this_thread::sleep_for(Delay);
+            });
+            while (!started) std::this_thread::yield(); // the other worker stole it
+            group.wait();
+        });
+        pool.shutdown();
+        return cpu < 0.1;
+    });
+    runCase("a parked worker wakes for work it can help with", [] {
+        ThreadPool pool(1);
+        std::atomic<int> ran{0};
+        std::future<void> waiter = pool.submit([&pool, &ran] {
+            std::atomic<bool> flag{false};
+            pool.scheduleAfter(std::chrono::milliseconds(50), [&pool, &ran, &flag] {
+                // only the parked waiter is left to run these
+                for (int i = 0; i < 10; ++i) pool.post([&ran] { ++ran; });
+                pool.post([&flag] { flag = true; });
+            });
+            pool.helpUntil([&flag] { return flag.load(); });
+        });
+        waiter.get();
+        pool.shutdown();
+        return ran == 10;
+    });
+
+    return finish();
+}
@@ -47,13 +47,13 @@ int main() {
 
         // Create thread pool
         ThreadPool pool(numThreads);
-        std::vector<std::future<std::string>> results;
-
-        // Submit tasks
+        // Prepare tasks, then submit them all under one lock
+        std::vector<std::function<std::string()>> batch;
         for (int i = 1; i <= numTasks; ++i) {
             int duration = randomDuration(500, 2000); // 0.5s to 2s
-            results.push_back(pool.submit(doTask, i, duration));
+            batch.push_back([i, duration] { return doTask(i, duration); });
         }
+        std::vector<std::future<std::string>> results = pool.submitBulk(batch.begin(), batch.end());
 
         // Collect results
         std::cout << "\n--- Task Results ---\n";